@@ -8,9 +8,15 @@
 #include <map>
 #include <queue>
 #include <format>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
 #include <spdlog/spdlog.h> 
 #include <spdlog/sinks/rotating_file_sink.h>
+#include <stdexcept>
 #include <GLFW/glfw3.h>
+#include "stratoceph/runtime/runtime.hpp"
 
 namespace glfw {
   struct GLFW_RAII {
@@ -44,7 +50,7 @@ namespace glfw {
 
   std::string chars{};
 
-  void key_callback(GLFWwindow *window, int key, int scancode, int action,
+  void key_callback(GLFWwindow*, int key, int /*scancode*/, int action,
                     int mods) {
     spdlog::info("glfw::key_callback");
     if (action == GLFW_PRESS) {
@@ -58,40 +64,133 @@ namespace glfw {
 namespace html_msg_imgui_glfw {
 
 
-  // Renders doc as HTML to ncurses screen
+  // Renders doc as HTML to the current GLFW window. Returns the prompt text.
+  // Text is resolved as by the ncurses renderer (referenced, see Html_Msg::set_text_ref, or owned by the document).
   // Note: HTML doc semantics may be tested at:
   // https://www.w3schools.com/html/tryit.asp?filename=tryhtml_intro
-  void render(const pugi::xml_document &doc) {
+  inline std::string_view render(const pugi::xml_document &doc, std::span<std::string_view const> texts = {}) {
 
     // Parse the HTML-like structure
     pugi::xml_node html = doc.child("html");
     pugi::xml_node body = html.child("body");
 
-    int current_y = 1; // Start from row 1 to leave space for the top border
+    std::string_view prompt{};
     int num_divs = 0;
 
     // Loop through divs directly and render them in sections
     for (auto const &div : body.children("div")) {
-      // Render the content of the div inside the windows
-      const std::string text = div.text().as_string();
-      num_divs++;
+      std::string_view const div_class = div.attribute("class").value();
+      if (div_class == "content") {
+        // Render the content of the div inside the windows (no text drawing on GL yet)
+        auto const text = runtime::text_of(div, texts);
+        (void)text;
+        num_divs++;
+      }
+      else if (div_class == "user-prompt") {
+        prompt = runtime::text_of(div.child("label"), texts);
+      }
     }
+    return prompt;
   }
+
+  // The GLFW window runtime::Backend (keys from glfw::key_callback)
+  class Backend {
+  public:
+    Backend() {
+      if (not m_glfw.m_init_ok) throw std::runtime_error("html_msg_imgui_glfw::Backend: glfwInit failed");
+      /* Create a windowed mode window and its OpenGL context */
+      m_window = glfwCreateWindow(640, 480, "Hello World", NULL, NULL);
+      if (m_window == nullptr) throw std::runtime_error("html_msg_imgui_glfw::Backend: glfwCreateWindow failed");
+      /* Make the window's context current */
+      glfwMakeContextCurrent(m_window);
+      // Register the key callback
+      glfwSetKeyCallback(m_window, glfw::key_callback);
+      // Content lost to an expose or resize is drawn again (see needs_redraw)
+      glfwSetWindowUserPointer(m_window, this);
+      glfwSetWindowRefreshCallback(m_window, [](GLFWwindow* window) {
+        static_cast<Backend*>(glfwGetWindowUserPointer(window))->m_redraw = true;
+      });
+      glfwSetFramebufferSizeCallback(m_window, [](GLFWwindow* window, int, int) {
+        static_cast<Backend*>(glfwGetWindowUserPointer(window))->m_redraw = true;
+      });
+    }
+    ~Backend() {
+      if (m_window != nullptr) glfwDestroyWindow(m_window);
+    }
+    Backend(Backend const&) = delete;
+    Backend& operator=(Backend const&) = delete;
+
+    void select() {glfwMakeContextCurrent(m_window);}
+
+    // Hides the window until the next render (and forgets the last key, see exit_code)
+    void suspend() {
+      glfwHideWindow(m_window);
+      m_hidden = true;
+      m_last_key = ' ';
+    }
+
+    void render(pugi::xml_document const& doc, std::span<std::string_view const> texts = {}) {
+      if (m_hidden) {
+        glfwShowWindow(m_window);
+        m_hidden = false;
+      }
+      /* Render here */
+      glClear(GL_COLOR_BUFFER_BIT);
+      if (auto prompt = html_msg_imgui_glfw::render(doc, texts); prompt != m_title) {
+        // The prompt line (as the bottom line of the ncurses screen)
+        m_title = prompt;
+        glfwSetWindowTitle(m_window, m_title.c_str());
+      }
+      /* Swap front and back buffers */
+      glfwSwapBuffers(m_window);
+      m_redraw = false;
+    }
+
+    // True once after the window was exposed or resized (its content must be drawn again)
+    bool needs_redraw() {return std::exchange(m_redraw,false);}
+
+    void read_keys(std::vector<int>& keys) {
+      /* Poll for and process events */
+      glfwPollEvents();
+      for (auto ch : glfw::chars) {
+        keys.push_back(ch);
+        m_last_key = ch;
+      }
+      glfw::chars.clear();
+    }
+
+    int input_fd() const {return -1;} // Polled
+
+    void wait(int timeout_ms) {
+      if (timeout_ms < 0) glfwWaitEvents();
+      else glfwWaitEventsTimeout(timeout_ms / 1000.0);
+    }
+
+    bool open() const {return not glfwWindowShouldClose(m_window);}
+
+    int exit_code() const {return (m_last_key == '-') ? 1 : 0;}
+
+  private:
+    glfw::GLFW_RAII m_glfw{};
+    GLFWwindow* m_window{};
+    int m_last_key{' '};
+    bool m_hidden{false};
+    bool m_redraw{false};
+    std::string m_title{};
+  };
 } // namespace
 
 namespace tea {
     template <typename Msg>
-    using IsQuit = std::function<bool(Msg)>;
+    using IsQuit = runtime::IsQuit<Msg>;
   
     // Event is a key-value-pair
-    using Event = std::map<std::string,std::string>;
+    using Event = ::Event;
 
     template <typename Msg>
-    struct Html_Msg {
-        pugi::xml_document doc{};
-        std::map<std::string,std::function<std::optional<Msg>(Event)>> event_handlers{};
-    };
+    using Html_Msg = ::Html_Msg<Msg>;
 
+    // The runtime core loop on a GLFW window
     template <typename Model, typename Msg> 
     class App {
     public:
@@ -102,92 +201,21 @@ namespace tea {
       using update_fn = std::function<std::pair<Model, Cmd>(Model, Msg)>;
       App(init_fn init, view_fn view, update_fn update)
           : m_init(init), m_view(view), m_update(update) {};
-      int run(int argc, char *argv[]) {
+      // Runs on a window of its own, or on a borrowed html_msg_imgui_glfw::Backend& (kept across runs)
+      template <typename... Args>
+      int run(int argc, char *argv[], Args&&... backend_args) {
         spdlog::info("tea::App::run - BEGIN");
-
-        glfw::GLFW_RAII glfw_raii{};
-
-        /* Create a windowed mode window and its OpenGL context */
-        GLFWwindow* window;        
-        window = glfwCreateWindow(640, 480, "Hello World", NULL, NULL);
-        if (!window) {
-            return -1;
-        }        
-
-        /* Make the window's context current */
-        glfwMakeContextCurrent(window);
-
-        // Register the key callback
-        glfwSetKeyCallback(window, glfw::key_callback);
-
-        int ch = ' '; // Variable to store the user's input
-
-        std::queue<Msg> msg_q{};
-        std::queue<Cmd> cmd_q{};
-        auto [model, is_quit_msg, cmd] = m_init();
-        cmd_q.push(cmd);
-        // Main loop
-        int loop_count{};
-        while (not glfwWindowShouldClose(window)) {
-          spdlog::default_logger()->flush();
-
-          spdlog::info(
-              "tea::App::run loop_count: {}, cmd_q size: {}, msg_q size: {}",
-              loop_count, cmd_q.size(), msg_q.size());
-
-          /* Render here */
-          glClear(GL_COLOR_BUFFER_BIT);
-          // render the ux
-          auto ui = m_view(model);
-          html_msg_imgui_glfw::render(ui.doc);
-
-          /* Swap front and back buffers */
-          glfwSwapBuffers(window);
-
-          /* Poll for and process events */
-          glfwPollEvents();
-                          
-          if (not cmd_q.empty()) {
-            // Execute a command
-            auto cmd = cmd_q.front();
-            cmd_q.pop();
-            if (auto msg = cmd()) {
-              msg_q.push(*msg);
-            }
-          } else if (not msg_q.empty()) {
-            auto msg = msg_q.front();
-            msg_q.pop();
-
-            // Try client provided predicate to identify QUIT msg
-            if (is_quit_msg(msg)) {
-              break;
-            }
-
-            // Run the message though the client
-            auto const &[m, cmd] = m_update(model, msg);
-            model = m;
-            cmd_q.push(cmd);
-          } else {
-            // Wait for user input / events
-
-            if (glfw::chars.size()>0) {
-              ch = glfw::chars.back(); glfw::chars.pop_back();
-              if (ui.event_handlers.contains("OnKey")) {
-                Event key_event{{"Key", std::to_string(ch)}};
-                if (auto optional_msg = ui.event_handlers["OnKey"](key_event))
-                  msg_q.push(*optional_msg);
-              } else {
-                throw std::runtime_error(std::format(
-                    "DESIGN INSUFFICIENCY, tea::App::run failed to find a "
-                    "binding 'OnKey' from client 'view' function"));
-              }  
-            }
-          }
-          ++loop_count;
+        int result{-1};
+        try {
+          Runtime<Model, Msg, Cmd, html_msg_imgui_glfw::Backend> runtime{m_init, m_view, m_update};
+          result = runtime.run(argc, argv, std::forward<Args>(backend_args)...);
+        }
+        catch (std::exception const& e) {
+          spdlog::error("tea::App::run failed, {}",e.what());
+          throw; // E.g., a DESIGN INSUFFICIENCY of the client is not a window that quit
         }
         spdlog::info("tea::App::run - END");
-
-        return (ch == '-') ? 1 : 0;
+        return result;
       }
 
     private:
@@ -1,54 +1,171 @@
 #pragma once
 
-#include <functional>
-#include <memory>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <format>
 #include <pugixml.hpp>
-#include <map>
 #include <ncurses.h>
-#include <queue>
-#include <format>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+#include <unistd.h>
 #include <spdlog/spdlog.h> 
 #include <spdlog/sinks/rotating_file_sink.h>
-
-namespace runtime {
-  template <typename Msg>
-  using IsQuit = std::function<bool(Msg)>;
-}
+#include "stratoceph/runtime/runtime.hpp"
 
 namespace html_msg_ncurses {
 
+  // One ncurses SCREEN (the process terminal, or e.g. a socket for a server session), on its own copies of the files.
+  // Note: delscreen frees the windows of every SCREEN (seen with ncurses 6.4), so while other SCREENs are open a
+  //       closed one is ended and its files closed (ncurses does no I/O on them after endwin, not even in delscreen),
+  //       and only the SCREEN is kept, to be deleted together with the last one. (Neither can it be shrunk first,
+  //       resizeterm too acts on the windows of every SCREEN.)
   class Ncurses {
   public:
-    Ncurses() {
-      initscr();
+    Ncurses() : Ncurses(stdout, stdin) {}
+    Ncurses(FILE* out, FILE* in) : m_out{copy(out, "w")}, m_in{copy(in, "r")}, m_screen{open(m_out, m_in)} {
+      if (m_screen == nullptr) {
+        if (m_out != nullptr) std::fclose(m_out);
+        if (m_in != nullptr) std::fclose(m_in);
+        throw std::runtime_error(std::format("Ncurses: newterm failed for TERM:{}",getenv("TERM") ? getenv("TERM") : "?"));
+      }
+      ++open_count();
       cbreak();
       noecho();
       keypad(stdscr, TRUE);
       refresh();
     }
     ~Ncurses() {
+      set_term(m_screen);
       endwin(); // End ncurses mode
+      if (--open_count() > 0) {
+        std::fclose(m_out);
+        std::fclose(m_in);
+        closed().push_back(m_screen);
+        if (auto const count = closed().size(); count >= 64 and (count & (count - 1)) == 0) {
+          spdlog::warn("Ncurses: {} ended SCREENs kept until the last of {} open ones ends",count,open_count());
+        }
+        return;
+      }
+      for (auto screen : closed()) delscreen(screen);
+      closed().clear();
+      delscreen(m_screen);
+      std::fclose(m_out);
+      std::fclose(m_in);
+    }
+    Ncurses(Ncurses const&) = delete;
+    Ncurses& operator=(Ncurses const&) = delete;
+
+    // Make this the current SCREEN (stdscr, getch, ... act on it)
+    void select() {
+      set_term(m_screen);
+    }
+
+  private:
+    static int& open_count() {
+      static int result{};
+      return result;
     }
+
+    // The SCREENs ended while others were open
+    static std::vector<SCREEN*>& closed() {
+      static std::vector<SCREEN*> result{};
+      return result;
+    }
+
+    static FILE* copy(FILE* file, char const* mode) {
+      if (file == nullptr) return nullptr;
+      int fd = ::dup(fileno(file));
+      if (fd < 0) return nullptr;
+      if (FILE* result = ::fdopen(fd, mode)) return result;
+      ::close(fd);
+      return nullptr;
+    }
+
+    static SCREEN* open(FILE* out, FILE* in) {
+      if (out == nullptr or in == nullptr) return nullptr;
+#ifdef __APPLE__
+      // Quick fix to make ncurses find the terminal setting on macOS
+      setenv("TERMINFO", "/usr/share/terminfo", 1);
+#endif
+      return newterm(nullptr, out, in);
+    }
+
+    FILE* m_out;
+    FILE* m_in;
+    SCREEN* m_screen;
   };
 
+  // The ncurses runtime::Backend. Renders to, and reads keys from, one terminal.
   class Renderer {
   public:
-    Renderer() : m_ncurses{} {}
-    ~Renderer() = default;
+    Renderer() : Renderer(stdout, stdin) {}
+    Renderer(FILE* out, FILE* in) : m_ncurses{out, in}, m_input_fd{fileno(in)} {}
+    ~Renderer() {
+      m_ncurses.select();
+      for (auto win : {m_top_win, m_middle_win, m_bottom_win}) {
+        if (win != nullptr) delwin(win);
+      }
+    }
+    Renderer(Renderer const&) = delete;
+    Renderer& operator=(Renderer const&) = delete;
+
+    void select() {
+      m_ncurses.select();
+    }
+
+    // Leaves curses mode (the terminal is usable by others) until the next render
+    void suspend() {
+      select();
+      endwin();
+    }
+
+    int input_fd() const {return m_input_fd;}
+
+    // Appends the available keys (type-ahead, paste, replay) without blocking
+    void read_keys(std::vector<int>& keys) {
+      select();
+      nodelay(stdscr, TRUE);
+      int ch{};
+      while ((ch = getch()) != ERR) keys.push_back(ch);
+      nodelay(stdscr, FALSE);
+    }
+
+    // Blocks at most timeout_ms (-1 = forever) for a key, and leaves it to read_keys
+    void wait(int timeout_ms) {
+      select();
+      timeout(timeout_ms);
+      if (int ch = getch(); ch != ERR) ungetch(ch);
+      timeout(-1);
+    }
+
+    int scroll_pages(int key) const {
+      if (key == KEY_PPAGE) return -1;
+      if (key == KEY_NPAGE) return 1;
+      return 0;
+    }
+
+    // Lines inside a content section (of the current screen size)
+    int page_lines() const {
+      return std::max(section_height() - 2, 1); // Accounting for borders
+    }
 
-    void render_section(WINDOW *win, const std::string &text, int start_y,
+    void render_section(WINDOW *win, std::string_view text, int start_y,
                         int max_lines) {
+      int const max_width = std::max(getmaxx(win) - 2, 0); // Accounting for borders
       int line_count = 0;
       size_t pos = 0;
       while (pos < text.size() && line_count < max_lines) {
         size_t next_line_pos = text.find('\n', pos);
-        if (next_line_pos == std::string::npos) {
+        if (next_line_pos == std::string_view::npos) {
           next_line_pos = text.size();
         }
 
-        std::string line = text.substr(pos, next_line_pos - pos);
-        mvwprintw(win, start_y + line_count, 1, "%s",
-                  line.c_str()); // Render inside window
+        auto line = text.substr(pos, next_line_pos - pos);
+        mvwaddnstr(win, start_y + line_count, 1, line.data(),
+                   std::min(static_cast<int>(line.size()), max_width)); // Render inside window
 
         line_count++;
         pos = next_line_pos + 1; // Move to the next line
@@ -56,10 +173,22 @@ namespace html_msg_ncurses {
       wnoutrefresh(win); // update to buffer
     }
 
-    void render_prompt(WINDOW *win, const pugi::xml_node &prompt_node) {
+    // Shows which lines of a windowed section are visible, e.g. '[11-20/100000]' (see Html_Msg::set_window)
+    void render_position(WINDOW *win, pugi::xml_node const& div, int max_lines) {
+      auto const lines = div.attribute("data-lines").as_ullong();
+      if (lines <= static_cast<unsigned long long>(max_lines)) return; // All visible
+      auto const first = div.attribute("data-first").as_ullong();
+      auto const last = std::min(first + max_lines, lines);
+      auto const position = std::format("[{}-{}/{}]", first + 1, last, lines);
+      int const x = getmaxx(win) - static_cast<int>(position.size()) - 1;
+      if (x > 0) mvwaddnstr(win, 0, x, position.data(), static_cast<int>(position.size()));
+      wnoutrefresh(win);
+    }
+
+    void render_prompt(WINDOW *win, const pugi::xml_node &prompt_node, std::span<std::string_view const> texts) {
       // User prompt at the bottom of the screen (in the last row)
-      const std::string prompt_text = prompt_node.child("label").text().as_string();
-      mvwprintw(win, 1, 1, "%s", prompt_text.c_str());
+      auto const prompt_text = runtime::text_of(prompt_node.child("label"), texts);
+      mvwaddnstr(win, 1, 1, prompt_text.data(), static_cast<int>(prompt_text.size()));
       wmove(win, 1, prompt_text.size() + 1); // Move cursor after the prompt
       wnoutrefresh(win);                     // Update to buffer
     }
@@ -67,28 +196,14 @@ namespace html_msg_ncurses {
     // Renders doc as HTML to ncurses screen
     // Note: HTML doc semantics may be tested at:
     // https://www.w3schools.com/html/tryit.asp?filename=tryhtml_intro
-    void render(const pugi::xml_document &doc) {
-      int screen_height, screen_width;
-      getmaxyx(stdscr, screen_height, screen_width); // Get screen dimensions
-
-      // Create a window for the app screen area (excluding the last row for the
-      // prompt)
-      int app_screen_height =
-          screen_height - 1; // Excluding the bottom row for the prompt
-      int section_height =
-          app_screen_height /
-          3; // Divide the remaining screen height into three sections
+    void render(const pugi::xml_document &doc, std::span<std::string_view const> texts = {}) {
+      int section_height = layout();
 
-      // Create windows for the app screen sections
-      WINDOW *top_win = newwin(section_height, screen_width, 0, 0);
-      box(top_win, 0, 0); // Draw border around the top section
-
-      WINDOW *middle_win = newwin(section_height, screen_width, section_height, 0);
-      box(middle_win, 0, 0); // Draw border around the middle section
-
-      WINDOW *bottom_win =
-          newwin(section_height, screen_width, 2 * section_height, 0);
-      box(bottom_win, 0, 0); // Draw border around the bottom section
+      // Clear and draw borders around the sections
+      for (auto win : {m_top_win, m_middle_win, m_bottom_win}) {
+        werase(win);
+        box(win, 0, 0);
+      }
 
       // Parse the HTML-like structure
       pugi::xml_node html = doc.child("html");
@@ -100,18 +215,19 @@ namespace html_msg_ncurses {
       // Loop through divs directly and render them in sections
       for (auto const &div : body.children("div")) {
         // Render the content of the div inside the windows
-        const std::string text = div.text().as_string();
+        const std::string_view div_class = div.attribute("class").as_string();
         const int max_lines = section_height - 2; // Accounting for borders
 
-        if (div.attribute("class").as_string() == std::string("content")) {
+        if (div_class == "content") {
           if (num_divs == 0) {
-            render_section(top_win, text, current_y, max_lines);
+            render_section(m_top_win, runtime::text_of(div, texts), current_y, max_lines);
+            render_position(m_top_win, div, max_lines);
           } else if (num_divs == 1) {
-            render_section(middle_win, text, current_y, max_lines);
+            render_section(m_middle_win, runtime::text_of(div, texts), current_y, max_lines);
+            render_position(m_middle_win, div, max_lines);
           }
-        } else if (div.attribute("class").as_string() ==
-                  std::string("user-prompt")) {
-          render_prompt(bottom_win, div);
+        } else if (div_class == "user-prompt") {
+          render_prompt(m_bottom_win, div, texts);
         }
         num_divs++;
       }
@@ -119,100 +235,43 @@ namespace html_msg_ncurses {
     }
 
   private:
-    Ncurses m_ncurses;
-  };
-
-} // namespace html_msg_ncurses
-
-// Event is a key-value-pair
-using Event = std::map<std::string,std::string>;
-
-template <typename Msg>
-struct Html_Msg {
-    pugi::xml_document doc{};
-    std::map<std::string,std::function<std::optional<Msg>(Event)>> event_handlers{};
-};
-
-template <typename Model, typename Msg, typename Cmd>
-class Runtime {
-public:
-  using Html = Html_Msg<Msg>;
-  using init_fn = std::function<std::tuple<Model,runtime::IsQuit<Msg>,Cmd>()>;
-  using view_fn = std::function<Html(Model)>;
-  using update_fn = std::function<std::pair<Model, Cmd>(Model, Msg)>;
-  Runtime(init_fn init, view_fn view, update_fn update)
-      : m_init(init), m_view(view), m_update(update) {};
-  int run(int argc, char *argv[]) {
-#ifdef __APPLE__
-    // Quick fix to make ncurses find the terminal setting on macOS
-    setenv("TERMINFO", "/usr/share/terminfo", 1);
-#endif
-
-    spdlog::info("Runtime::run - BEGIN");
-
-    html_msg_ncurses::Renderer renderer{};
-
-
-    int ch = ' '; // Variable to store the user's input
-
-    std::queue<Msg> msg_q{};
-    std::queue<Cmd> cmd_q{};
-    auto [model, is_quit_msg, cmd] = m_init();
-    cmd_q.push(cmd);
-    // Main loop
-    int loop_count{};
-    int result{1}; // Hack.
-    while (true) {
-
-      spdlog::info("Runtime::run loop_count: {}, cmd_q size: {}, msg_q size: {}", loop_count,cmd_q.size(), msg_q.size());
-
-      // render the ux
-      auto ui = m_view(model);
-      renderer.render(ui.doc);
-
-      if (not cmd_q.empty()) {
-        // Execute a command
-        auto cmd = cmd_q.front(); cmd_q.pop();
-        if (auto msg = cmd()) {
-          msg_q.push(*msg);
-        }
-      }
-      else if (not msg_q.empty()) {
-        auto msg = msg_q.front(); msg_q.pop();
+    static int section_height() {
+      // The app screen area excludes the bottom row for the prompt,
+      // and is divided into three sections
+      return (getmaxy(stdscr) - 1) / 3;
+    }
 
-        // Try client provided predicate to identify QUIT msg
-        if (is_quit_msg(msg)) {
-          // result = 0; // Hack
-          break;
-        }
+    // (Re)creates the section windows when the screen size changed. Returns the section height
+    int layout() {
+      int screen_height, screen_width;
+      getmaxyx(stdscr, screen_height, screen_width); // Get screen dimensions
+      int const section_height = this->section_height();
 
-        // Run the message though the client
-        auto const &[m, cmd] = m_update(model, msg);
-        model = m;
-        cmd_q.push(cmd);
-      }
-      else {
-        // Wait for user input
-        ch = getch();
-        spdlog::info("Runtime::run ch={}",ch);
-        if (ui.event_handlers.contains("OnKey")) {
-          Event key_event{{"Key",std::to_string(ch)}};
-          if (auto optional_msg = ui.event_handlers["OnKey"](key_event)) msg_q.push(*optional_msg);
-        }
-        else {
-          throw std::runtime_error(std::format("DESIGN INSUFFICIENCY, Runtime::run failed to find a binding 'OnKey' from client 'view' function"));
+      if (screen_height != m_screen_height or screen_width != m_screen_width) {
+        for (auto win : {m_top_win, m_middle_win, m_bottom_win}) {
+          if (win != nullptr) delwin(win);
         }
+        // Create windows for the app screen sections
+        m_top_win = newwin(section_height, screen_width, 0, 0);
+        m_middle_win = newwin(section_height, screen_width, section_height, 0);
+        m_bottom_win = newwin(section_height, screen_width, 2 * section_height, 0);
+        m_screen_height = screen_height;
+        m_screen_width = screen_width;
       }
-      ++loop_count;
+      return section_height;
     }
-    spdlog::info("Runtime::run - END");
 
-    // Hack.
-    return result;
-  }
+    Ncurses m_ncurses;
+    int m_input_fd;
+    WINDOW* m_top_win{};
+    WINDOW* m_middle_win{};
+    WINDOW* m_bottom_win{};
+    int m_screen_height{-1};
+    int m_screen_width{-1};
+  };
+
+} // namespace html_msg_ncurses
 
-private:
-  init_fn m_init;
-  view_fn m_view;
-  update_fn m_update;
-};
+// The process terminal is the default backend
+template <typename Model, typename Msg, typename Cmd, typename Backend = html_msg_ncurses::Renderer>
+class Runtime;
@@ -0,0 +1,156 @@
+#pragma once
+// Allocation profiling. Heap allocations are counted per runtime loop phase (input, view, render, update, cmd)
+// of the calling thread, and a Runtime with an allocation Budget checks them every frame.
+// Opt-in: define STRATOCEPH_ALLOC_PROFILE_NEW in exactly ONE translation unit (before any include of this header)
+// to replace the global operator new / delete with counting ones. Without it only CountingResource (pmr) counts.
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <format>
+#include <limits>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace runtime::alloc {
+
+  enum class Phase : std::size_t {Other, Input, View, Render, Update, Cmd};
+  inline constexpr std::size_t PHASE_COUNT{6};
+  inline constexpr std::array<std::string_view,PHASE_COUNT> PHASE_NAMES{"other","input","view","render","update","cmd"};
+
+  struct Counters {
+    std::size_t allocations{};
+    std::size_t bytes{};
+  };
+
+  using PhaseCounters = std::array<Counters,PHASE_COUNT>;
+
+  inline constexpr Counters UNLIMITED{std::numeric_limits<std::size_t>::max(),std::numeric_limits<std::size_t>::max()};
+
+  // The phase of this thread and its counters (constant initialized, safe to use from operator new)
+  inline thread_local Phase current_phase{Phase::Other};
+  inline thread_local PhaseCounters counters{};
+
+  inline void count(PhaseCounters& counters, std::size_t bytes) {
+    auto& counted = counters[static_cast<std::size_t>(current_phase)];
+    ++counted.allocations;
+    counted.bytes += bytes;
+  }
+
+  // Attributes the allocations of this thread to phase while alive
+  class PhaseScope {
+  public:
+    explicit PhaseScope(Phase phase) : m_previous{std::exchange(current_phase,phase)} {}
+    ~PhaseScope() {current_phase = m_previous;}
+    PhaseScope(PhaseScope const&) = delete;
+    PhaseScope& operator=(PhaseScope const&) = delete;
+  private:
+    Phase m_previous;
+  };
+
+  // The counters of this thread since the last take
+  inline PhaseCounters take() {return std::exchange(counters,PhaseCounters{});}
+
+  // "view:12/1480B render:3/96B ..." (phases without allocations are left out)
+  inline std::string to_string(PhaseCounters const& counted) {
+    std::string result{};
+    for (std::size_t i=0;i<PHASE_COUNT;++i) {
+      if (counted[i].allocations == 0) continue;
+      if (not result.empty()) result.push_back(' ');
+      result += std::format("{}:{}/{}B",PHASE_NAMES[i],counted[i].allocations,counted[i].bytes);
+    }
+    return result.empty() ? std::string{"none"} : result;
+  }
+
+  // Max allocations and bytes per phase of one frame
+  struct Budget {
+    PhaseCounters max{UNLIMITED,UNLIMITED,UNLIMITED,UNLIMITED,UNLIMITED,UNLIMITED};
+    bool fail{false}; // Throw (e.g., fail a test) rather than log a warning when exceeded
+
+    Budget& limit(Phase phase, std::size_t allocations, std::size_t bytes = UNLIMITED.bytes) {
+      max[static_cast<std::size_t>(phase)] = Counters{allocations,bytes};
+      return *this;
+    }
+
+    // The phases over budget, e.g. "view:12/1480B > 8/-" (empty if within budget)
+    std::string exceeded(PhaseCounters const& frame) const {
+      std::string result{};
+      for (std::size_t i=0;i<PHASE_COUNT;++i) {
+        if (frame[i].allocations <= max[i].allocations and frame[i].bytes <= max[i].bytes) continue;
+        auto limit = [](std::size_t value) {return value == UNLIMITED.bytes ? std::string{"-"} : std::to_string(value);};
+        if (not result.empty()) result.push_back(' ');
+        result += std::format("{}:{}/{}B > {}/{}",PHASE_NAMES[i],frame[i].allocations,frame[i].bytes,limit(max[i].allocations),limit(max[i].bytes));
+      }
+      return result;
+    }
+  };
+
+  // Counts the allocations made through it (per phase of the allocating thread), then forwards them upstream
+  class CountingResource : public std::pmr::memory_resource {
+  public:
+    explicit CountingResource(std::pmr::memory_resource* upstream = std::pmr::get_default_resource()) : m_upstream{upstream} {}
+
+    PhaseCounters const& counted() const {return m_counted;}
+    PhaseCounters take() {return std::exchange(m_counted,PhaseCounters{});}
+
+  private:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+      count(m_counted, bytes);
+      return m_upstream->allocate(bytes, alignment);
+    }
+    void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override {
+      m_upstream->deallocate(p, bytes, alignment);
+    }
+    bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override {
+      return this == &other;
+    }
+
+    std::pmr::memory_resource* m_upstream;
+    PhaseCounters m_counted{};
+  };
+
+} // namespace runtime::alloc
+
+#if defined(STRATOCEPH_ALLOC_PROFILE_NEW) and not defined(STRATOCEPH_ALLOC_PROFILE_NEW_DEFINED)
+#define STRATOCEPH_ALLOC_PROFILE_NEW_DEFINED
+
+namespace runtime::alloc {
+  // Frees what the operator new below allocated. Not inlined, so the compiler does not see free() called on a
+  // pointer from new (-Wmismatched-new-delete at every inlined delete).
+  [[gnu::noinline]] inline void release(void* p) noexcept {std::free(p);}
+}
+
+void* operator new(std::size_t size) {
+  runtime::alloc::count(runtime::alloc::counters, size);
+  if (void* p = std::malloc(size == 0 ? 1 : size)) return p;
+  throw std::bad_alloc{};
+}
+void* operator new[](std::size_t size) {return ::operator new(size);}
+void* operator new(std::size_t size, std::nothrow_t const&) noexcept {
+  runtime::alloc::count(runtime::alloc::counters, size);
+  return std::malloc(size == 0 ? 1 : size);
+}
+void* operator new[](std::size_t size, std::nothrow_t const& tag) noexcept {return ::operator new(size, tag);}
+void* operator new(std::size_t size, std::align_val_t alignment) {
+  runtime::alloc::count(runtime::alloc::counters, size);
+  auto const align = static_cast<std::size_t>(alignment);
+  if (void* p = std::aligned_alloc(align, (size == 0) ? align : (size + align - 1) / align * align)) return p;
+  throw std::bad_alloc{};
+}
+void* operator new[](std::size_t size, std::align_val_t alignment) {return ::operator new(size, alignment);}
+void operator delete(void* p, std::align_val_t) noexcept {runtime::alloc::release(p);}
+void operator delete[](void* p, std::align_val_t) noexcept {runtime::alloc::release(p);}
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept {runtime::alloc::release(p);}
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept {runtime::alloc::release(p);}
+void operator delete(void* p) noexcept {runtime::alloc::release(p);}
+void operator delete[](void* p) noexcept {runtime::alloc::release(p);}
+void operator delete(void* p, std::size_t) noexcept {runtime::alloc::release(p);}
+void operator delete[](void* p, std::size_t) noexcept {runtime::alloc::release(p);}
+void operator delete(void* p, std::nothrow_t const&) noexcept {runtime::alloc::release(p);}
+void operator delete[](void* p, std::nothrow_t const&) noexcept {runtime::alloc::release(p);}
+
+#endif // STRATOCEPH_ALLOC_PROFILE_NEW
@@ -0,0 +1,104 @@
+#pragma once
+// A command that may be cancelled and deduplicated while pending in the runtime,
+// or that is a coroutine Task scheduled by the runtime event loop, or a batch of commands.
+
+#include <concepts>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <span>
+#include <type_traits>
+#include <vector>
+#include "stratoceph/runtime/task.hpp"
+
+namespace runtime {
+
+  template <typename Msg>
+  class Cmd {
+  public:
+    using fn_type = std::function<std::optional<Msg>(std::stop_token)>;
+
+    Cmd() = default; // Empty is Nop
+
+    // Plain command (no key, never cancelled)
+    template <typename F>
+      requires (not std::same_as<std::remove_cvref_t<F>,Cmd> and std::is_invocable_r_v<std::optional<Msg>,F>)
+    Cmd(F f) : m_fn{[f = std::move(f)](std::stop_token) -> std::optional<Msg> {return f();}} {}
+
+    // Keyed and cancellable command.
+    // A pending Cmd with the same key coalesces this one. A stop requested on token drops it
+    // from the queue, and f may take the token to abort early while it runs.
+    template <typename F>
+    Cmd(std::string key, std::stop_token token, F f) : m_key{std::move(key)}, m_token{std::move(token)} {
+      if constexpr (std::is_invocable_r_v<std::optional<Msg>,F,std::stop_token>) {
+        m_fn = std::move(f);
+      }
+      else {
+        m_fn = [f = std::move(f)](std::stop_token) -> std::optional<Msg> {return f();};
+      }
+    }
+
+    // Coroutine command. Handed over to the runtime scheduler when executed (once, a copy run again is ignored)
+    Cmd(Task<Msg>&& task) : m_task{std::make_shared<Task<Msg>>(std::move(task))} {}
+
+    // Keyed and cancellable coroutine command. A stop requested on token drops it, queued or running.
+    Cmd(std::string key, std::stop_token token, Task<Msg>&& task) : m_key{std::move(key)}, m_token{std::move(token)} {
+      task.stop_on(m_token);
+      m_task = std::make_shared<Task<Msg>>(std::move(task));
+    }
+
+    // Several commands queued in order, e.g., from Msgs applied together. Nops are left out
+    // (a batch of one is that Cmd, of none is Nop).
+    static Cmd batch(std::vector<Cmd> cmds) {
+      std::erase_if(cmds, [](Cmd const& cmd) {return not cmd;});
+      if (cmds.size() == 1) return std::move(cmds.front());
+      Cmd result{};
+      result.m_parts = std::move(cmds);
+      return result;
+    }
+
+    explicit operator bool() const {return m_fn or m_task or not m_parts.empty();}
+
+    std::optional<Msg> operator()() const {
+      if (cancelled() or not m_fn) return std::nullopt;
+      return m_fn(m_token);
+    }
+
+    std::shared_ptr<Task<Msg>> const& task() const {return m_task;}
+
+    // The Cmds of a batch (empty if not a batch)
+    std::span<Cmd const> parts() const {return m_parts;}
+
+    std::string const& key() const {return m_key;}
+    bool cancelled() const {return m_token.stop_requested();}
+
+  private:
+    std::string m_key{};
+    std::stop_token m_token{};
+    fn_type m_fn{};
+    std::shared_ptr<Task<Msg>> m_task{};
+    std::vector<Cmd> m_parts{};
+  };
+
+  // Cmd types the runtime can coalesce (by key) and drop (when cancelled)
+  template <typename Cmd>
+  concept KeyedCmd = requires(Cmd const& cmd) {
+    {cmd.key()} -> std::convertible_to<std::string>;
+    {cmd.cancelled()} -> std::convertible_to<bool>;
+  };
+
+  // Cmd types that may be a batch (queued as its parts)
+  template <typename Cmd>
+  concept BatchCmd = requires(Cmd const& cmd) {
+    {cmd.parts()} -> std::convertible_to<std::span<Cmd const>>;
+  };
+
+  // Cmd types that may carry a coroutine Task
+  template <typename Cmd>
+  concept TaskCmd = requires(Cmd const& cmd) {
+    {*cmd.task()};
+  };
+
+} // namespace runtime
@@ -0,0 +1,53 @@
+#pragma once
+// A runtime::Backend without terminal or window (tests, soak runs, benchmarks).
+// Keys come from a script, and rendered frames are counted (not drawn).
+
+#include <cstddef>
+#include <functional>
+#include <span>
+#include <string_view>
+#include <vector>
+#include <pugixml.hpp>
+
+namespace runtime {
+
+  class Headless {
+  public:
+    // Appends the next keys (maybe none). Returns false when done (ends the session).
+    using script_fn = std::function<bool(std::vector<int>& keys)>;
+
+    // Page keys (the curses key codes, so scripts and recordings mean the same)
+    static constexpr int KEY_PAGE_DOWN{0522};
+    static constexpr int KEY_PAGE_UP{0523};
+
+    Headless(script_fn script = {}, int page_lines = 10) : m_script{std::move(script)}, m_page_lines{page_lines} {}
+
+    void render(pugi::xml_document const&, std::span<std::string_view const> texts = {}) {
+      ++m_frames;
+      m_text_bytes = 0;
+      for (auto text : texts) m_text_bytes += text.size();
+    }
+
+    void read_keys(std::vector<int>& keys) {
+      if (m_script and not m_script(keys)) m_open = false;
+    }
+
+    int input_fd() const {return -1;}
+    int poll_ms() const {return 0;} // Never waits for input
+    bool open() const {return m_open;}
+    int page_lines() const {return m_page_lines;}
+    int scroll_pages(int key) const {return (key == KEY_PAGE_UP) ? -1 : (key == KEY_PAGE_DOWN) ? 1 : 0;}
+
+    std::size_t frames() const {return m_frames;}
+    // Size of the text referenced by the last frame
+    std::size_t text_bytes() const {return m_text_bytes;}
+
+  private:
+    script_fn m_script;
+    int m_page_lines;
+    bool m_open{true};
+    std::size_t m_frames{};
+    std::size_t m_text_bytes{};
+  };
+
+} // namespace runtime
@@ -0,0 +1,107 @@
+#pragma once
+// Memory resources for a session that does not allocate from the global heap in steady state.
+//   FrameMemory  - two monotonic arenas taking turns, one per rendered frame (view documents)
+//   pool()       - a pool for long-lived small objects of the loop thread (Msgs, States, Tasks)
+//   current()    - the resource of the running scope (ResourceScope), used by pugixml when installed
+// Note: pool() and current() are per thread. Objects from pool() must be released on the thread that made them.
+
+#include <array>
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <utility>
+#include <vector>
+#include <pugixml.hpp>
+
+namespace runtime::memory {
+
+  // The resource of this thread's running ResourceScope (nullptr = global heap)
+  inline thread_local std::pmr::memory_resource* current_resource{nullptr};
+
+  inline std::pmr::memory_resource* current() {
+    return current_resource != nullptr ? current_resource : std::pmr::get_default_resource();
+  }
+
+  // Makes resource current while alive
+  class ResourceScope {
+  public:
+    explicit ResourceScope(std::pmr::memory_resource* resource) : m_previous{std::exchange(current_resource,resource)} {}
+    ~ResourceScope() {current_resource = m_previous;}
+    ResourceScope(ResourceScope const&) = delete;
+    ResourceScope& operator=(ResourceScope const&) = delete;
+  private:
+    std::pmr::memory_resource* m_previous;
+  };
+
+  inline std::pmr::memory_resource& pool() {
+    thread_local std::pmr::unsynchronized_pool_resource result{};
+    return result;
+  }
+
+  // Arenas for frames. A frame's allocations live until the frame after the next one begins,
+  // so the previous frame (e.g., the view handling input) stays valid while the next one is built.
+  class FrameMemory {
+  public:
+    explicit FrameMemory(std::size_t bytes = 64*1024)
+      :  m_buffers{std::vector<std::byte>(bytes),std::vector<std::byte>(bytes)}
+        ,m_arenas{arena(0),arena(1)} {}
+    FrameMemory(FrameMemory const&) = delete;
+    FrameMemory& operator=(FrameMemory const&) = delete;
+
+    // Releases the arena of the frame before the previous one and returns it for the new frame
+    std::pmr::memory_resource* next() {
+      m_current = 1 - m_current;
+      m_arenas[m_current].release(); // Back to its initial buffer
+      return &m_arenas[m_current];
+    }
+
+  private:
+    std::pmr::monotonic_buffer_resource arena(std::size_t i) {
+      return std::pmr::monotonic_buffer_resource{m_buffers[i].data(),m_buffers[i].size(),&pool()};
+    }
+    std::array<std::vector<std::byte>,2> m_buffers;
+    std::array<std::pmr::monotonic_buffer_resource,2> m_arenas;
+    std::size_t m_current{};
+  };
+
+  // std::make_shared from pool()
+  template <typename T, typename... Args>
+  std::shared_ptr<T> make_pooled(Args&&... args) {
+    return std::allocate_shared<T>(std::pmr::polymorphic_allocator<T>{&pool()},std::forward<Args>(args)...);
+  }
+
+  // Routes all pugixml allocations (documents, nodes, text) of a ResourceScope to its resource.
+  // Outside any scope pugixml uses the global heap as before. Idempotent.
+  inline void install_pugixml() {
+    struct alignas(std::max_align_t) Header {
+      std::pmr::memory_resource* resource;
+      std::size_t size;
+    };
+    static bool const installed = [] {
+      pugi::set_memory_management_functions(
+         [](std::size_t size) -> void* {
+          auto const total = sizeof(Header) + size;
+          Header* header{};
+          try {
+            header = static_cast<Header*>(current_resource != nullptr ? current_resource->allocate(total,alignof(std::max_align_t)) : std::malloc(total));
+          }
+          catch (std::bad_alloc const&) {} // pugixml expects nullptr
+          if (header == nullptr) return nullptr;
+          header->resource = current_resource;
+          header->size = total;
+          return header + 1;
+        }
+        ,[](void* p) {
+          if (p == nullptr) return;
+          auto* header = static_cast<Header*>(p) - 1;
+          if (header->resource != nullptr) header->resource->deallocate(header,header->size,alignof(std::max_align_t));
+          else std::free(header);
+        });
+      return true;
+    }();
+    (void)installed;
+  }
+
+} // namespace runtime::memory
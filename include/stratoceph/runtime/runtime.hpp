@@ -0,0 +1,848 @@
+#pragma once
+// The runtime core loop, shared by all backends (ncurses, GLFW, headless, remote).
+// A Backend renders view documents and delivers key input:
+//   void render(pugi::xml_document const& doc, std::span<std::string_view const> texts)
+//   void read_keys(std::vector<int>& keys) // Appends the available keys without blocking
+//   int input_fd() const                   // Readable when keys are available (-1 = polled every poll_ms, or waited for)
+// and optionally
+//   void select()                          // Makes it current (e.g., an ncurses SCREEN)
+//   bool open() const                      // False ends the session (e.g., the window was closed)
+//   int poll_ms() const                    // Input poll interval without input_fd (default 10)
+//   void wait(int timeout_ms)              // Blocks for input (platforms without epoll, or no input_fd)
+//   int exit_code() const                  // Returned by Runtime::run
+//   int scroll_pages(int key) const        // -1 for a page up key, 1 for page down, else 0
+//   int page_lines() const                 // Lines of a scrollable content section (default 10)
+//   bool needs_redraw()                    // True once after its content was lost (e.g., an exposed or resized window)
+// Scroll keys go to the view's 'OnScroll' handler (if any) as {"Lines": signed lines, "Page": page_lines},
+// and so does a changed page_lines (with "Lines" 0). Other keys go to 'OnKey'.
+
+#include <concepts>
+#include <functional>
+#include <memory>
+#include <pugixml.hpp>
+#include <map>
+#include <memory_resource>
+#include <queue>
+#include <set>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <format>
+#include <filesystem>
+#include <chrono>
+#include <optional>
+#include <cstdio>
+#include <cstdlib>
+#include <csignal>
+#include <stdexcept>
+#include <spdlog/spdlog.h> 
+#include "stratoceph/runtime/alloc_profile.hpp"
+#include "stratoceph/runtime/cmd.hpp"
+#include "stratoceph/runtime/memory.hpp"
+#include "stratoceph/runtime/selector.hpp"
+#include "stratoceph/runtime/snapshot.hpp"
+#include "stratoceph/runtime/subscriptions.hpp"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace runtime {
+  template <typename Msg>
+  using IsQuit = std::function<bool(Msg)>;
+
+  // An empty (default constructed) Cmd is a 'Nop' and never enters the cmd queue
+  template <typename Cmd>
+  bool is_nop(Cmd const& cmd) {
+    return not static_cast<bool>(cmd);
+  }
+
+  // Draws view documents
+  template <typename R>
+  concept Renderer = requires(R& renderer, pugi::xml_document const& doc, std::span<std::string_view const> texts) {
+    renderer.render(doc, texts);
+  };
+
+  // Delivers key codes
+  template <typename I>
+  concept InputSource = requires(I& input, I const& const_input, std::vector<int>& keys) {
+    input.read_keys(keys);
+    {const_input.input_fd()} -> std::convertible_to<int>;
+  };
+
+  template <typename B>
+  concept Backend = Renderer<B> and InputSource<B>;
+
+  // The work queued in a session (e.g., sampled by a soak run, see runtime/soak.hpp)
+  struct QueueDepths {
+    std::size_t input{};
+    std::size_t msg{};
+    std::size_t cmd{};
+    std::size_t tasks{};
+  };
+
+  // The backend of a session. Made from arguments (owned by the session), or borrowed,
+  // e.g. a terminal or window kept across runs so a restart does not set it up again.
+  template <typename B>
+  class BackendHolder {
+  public:
+    template <typename... Args>
+    explicit BackendHolder(Args&&... args) : m_owned{std::make_unique<B>(std::forward<Args>(args)...)}, m_backend{m_owned.get()} {}
+    explicit BackendHolder(B& borrowed) : m_backend{&borrowed} {}
+    B& get() const {return *m_backend;}
+  private:
+    std::unique_ptr<B> m_owned{};
+    B* m_backend;
+  };
+
+  // Text of node. Either referenced (see Html_Msg::set_text_ref) or owned by the document
+  inline std::string_view text_of(pugi::xml_node const& node, std::span<std::string_view const> texts) {
+    if (auto ref = node.attribute("data-text")) {
+      if (auto index = ref.as_uint(); index < texts.size()) return texts[index];
+    }
+    return node.text().get();
+  }
+}
+
+// Event is a key-value-pair
+using Event = std::map<std::string,std::string>;
+
+template <typename Msg>
+struct Html_Msg {
+    pugi::xml_document doc{};
+    // Allocated from the current memory resource (the frame arena while the runtime calls view)
+    std::pmr::map<std::pmr::string,std::function<std::optional<Msg>(Event)>> event_handlers{runtime::memory::current()};
+    // Text referenced (not copied) by nodes with a 'data-text' index attribute
+    std::pmr::vector<std::string_view> texts{runtime::memory::current()};
+
+    // Makes node show text without copying it. text must outlive the render (e.g., point into the model).
+    void set_text_ref(pugi::xml_node node, std::string_view text) {
+      node.append_attribute("data-text") = static_cast<unsigned int>(texts.size());
+      texts.push_back(text);
+    }
+
+    // Declares that the text of node is the visible window (from line first) of a text of lines lines.
+    // The view produces only that slice, and the renderer shows where it is.
+    void set_window(pugi::xml_node node, std::size_t first, std::size_t lines) {
+      node.append_attribute("data-first") = static_cast<unsigned long long>(first);
+      node.append_attribute("data-lines") = static_cast<unsigned long long>(lines);
+    }
+};
+
+// The Elm Architecture core loop (init, view, update, Cmds, subscriptions) on a runtime::Backend.
+// The backend is a template parameter (no virtual dispatch in the loop).
+template <typename Model, typename Msg, typename Cmd, typename Backend>
+class Runtime {
+  static_assert(runtime::Backend<Backend>);
+public:
+  using Html = Html_Msg<Msg>;
+  using init_fn = std::function<std::tuple<Model,runtime::IsQuit<Msg>,Cmd>()>;
+  using view_fn = std::function<Html(Model const&)>; // Html may reference text in the model
+  using update_fn = std::function<std::pair<Model, Cmd>(Model, Msg)>;
+  // Optional. Folds all queued messages into one call (type-ahead, paste, replay)
+  using update_batch_fn = std::function<std::pair<Model, std::vector<Cmd>>(Model&&, std::span<const Msg>)>;
+  // Optional. Message sources (timers, file watches, fds) the model listens to
+  using subscriptions_fn = std::function<runtime::Subscriptions<Msg>(Model const&)>;
+  // Optional. Identifies the subscriptions of a model (e.g., the state they belong to).
+  // With it, subscriptions_fn is called only when the key changes (not on every update).
+  using subscriptions_key_fn = std::function<std::size_t(Model const&)>;
+  // Optional. Called once per session with the time from its start (backend set up included) to its first frame
+  using first_frame_fn = std::function<void(runtime::Clock::duration)>;
+  // Optional. Called after every pump with the work left queued
+  using pump_fn = std::function<void(runtime::QueueDepths const&)>;
+  Runtime(init_fn init, view_fn view, update_fn update, update_batch_fn update_batch = {}, subscriptions_fn subscriptions = {})
+      : m_init(init), m_view(view), m_update(update), m_update_batch(update_batch), m_subscriptions(subscriptions) {};
+
+  // run restores the model from path on startup, and saves it there at most every period while it changes.
+  // Requires a runtime::Snapshottable Model.
+  void set_snapshot(std::filesystem::path const& path, std::chrono::milliseconds period = std::chrono::seconds{1}) {
+    m_snapshot_path = path;
+    m_snapshot_period = period;
+  }
+
+  // Builds each view (document, handlers) in a per-frame arena of bytes, reused every other frame,
+  // so rendering a frame does not allocate from the global heap once warmed up.
+  void set_frame_memory(std::size_t bytes = 64*1024) {
+    m_frame_memory_bytes = bytes;
+  }
+
+  // Renders at most fps frames per second. Msgs applied within a frame are drawn once (the final model),
+  // and background work yields to input every frame.
+  void set_max_fps(unsigned fps) {
+    m_frame_interval = std::chrono::duration_cast<runtime::Clock::duration>(std::chrono::seconds{1}) / std::max(fps,1u);
+  }
+
+  // Checks the heap allocations of every frame (a view + render, or one Cmd or update) against budget.
+  // Counts require the counting operator new (see runtime/alloc_profile.hpp).
+  void set_allocation_budget(runtime::alloc::Budget const& budget) {
+    m_allocation_budget = budget;
+  }
+
+  void set_subscriptions_key(subscriptions_key_fn subscriptions_key) {
+    m_subscriptions_key = subscriptions_key;
+  }
+
+  void on_first_frame(first_frame_fn first_frame) {
+    m_first_frame = first_frame;
+  }
+
+  void on_pump(pump_fn pump) {
+    m_pump = pump;
+  }
+
+  // Runs one session on a Backend made from backend_args (e.g., the process terminal),
+  // or on a borrowed Backend& (kept, e.g., to restart without setting up the terminal again).
+  template <typename... Args>
+  int run([[maybe_unused]] int argc, [[maybe_unused]] char *argv[], Args&&... backend_args) {
+    spdlog::info("Runtime::run - BEGIN");
+
+    int result{1}; // Hack.
+#ifdef __linux__
+    // Input, subscriptions and coroutine Cmds are served by the same wait
+    runtime::Poller poller{};
+    Session session{*this, poller, std::forward<Args>(backend_args)...};
+    if (m_snapshot_path) session.enable_snapshot(*m_snapshot_path, m_snapshot_period);
+    auto const input_fd = session.input_fd();
+    if (input_fd >= 0) poller.add(input_fd);
+    while (session.pump() and session.open()) {
+      auto timeout_ms = session.timeout_ms();
+      if (input_fd < 0 and Session::waits and poller.size() == 0) {
+        // Only the backend to wait for (e.g., glfwWaitEventsTimeout), until the next subscription or Task is due
+        session.wait(timeout_ms);
+        session.read_input();
+        continue;
+      }
+      if (input_fd < 0) {
+        // Nothing to wait for, poll the input
+        timeout_ms = (timeout_ms < 0) ? session.poll_ms() : std::min(timeout_ms, session.poll_ms());
+      }
+      for (auto fd : poller.wait(timeout_ms)) {
+        if (fd == input_fd) session.read_input();
+        else session.dispatch(fd);
+      }
+      if (input_fd < 0) session.read_input();
+    }
+#else
+    Session session{*this, std::forward<Args>(backend_args)...};
+    if (m_snapshot_path) session.enable_snapshot(*m_snapshot_path, m_snapshot_period);
+    while (session.pump() and session.open()) {
+      session.wait(session.timeout_ms());
+      session.read_input();
+    }
+#endif
+    if constexpr (requires {{session.backend().exit_code()} -> std::convertible_to<int>;}) {
+      result = session.backend().exit_code();
+    }
+    spdlog::info("Runtime::run - END");
+
+    // Hack.
+    return result;
+  }
+
+#ifdef __linux__
+  // Hosts many independent sessions in this process, one per connection to a Unix socket, until SIGINT or SIGTERM.
+  // Connect with e.g., 'socat UNIX-CONNECT:<socket_path> STDIO,raw,echo=0'.
+  // Note: Sessions share the process (e.g., immutable data) but are multiplexed on this thread,
+  //       as ncurses keeps the current SCREEN in process global state. So a session never blocks on its client:
+  //       its terminal output is buffered and sent on without blocking (a client that does not keep up is dropped),
+  //       and a session that fails (throws) is dropped alone.
+  int serve(std::filesystem::path const& socket_path) requires std::constructible_from<Backend, FILE*, FILE*> {
+    spdlog::info("Runtime::serve {} - BEGIN",socket_path.string());
+    static volatile std::sig_atomic_t stop{0};
+    stop = 0;
+    // The signal handling while serving, the caller's restored however serve ends
+    struct Signals {
+      struct sigaction old_pipe{};
+      struct sigaction old_int{};
+      struct sigaction old_term{};
+      Signals() {
+        struct sigaction ignore{};
+        ignore.sa_handler = SIG_IGN; // A dropped client must not kill the server
+        struct sigaction on_stop{};
+        on_stop.sa_handler = [](int) {stop = 1;}; // No SA_RESTART, the wait returns
+        ::sigaction(SIGPIPE, &ignore, &old_pipe);
+        ::sigaction(SIGINT, &on_stop, &old_int);
+        ::sigaction(SIGTERM, &on_stop, &old_term);
+      }
+      ~Signals() {
+        ::sigaction(SIGPIPE, &old_pipe, nullptr);
+        ::sigaction(SIGINT, &old_int, nullptr);
+        ::sigaction(SIGTERM, &old_term, nullptr);
+      }
+      Signals(Signals const&) = delete;
+      Signals& operator=(Signals const&) = delete;
+    } signals{};
+
+    // The listening socket, closed and unlinked however serve ends
+    struct Listener {
+      std::filesystem::path path;
+      int fd{::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+      ~Listener() {
+        if (fd >= 0) ::close(fd);
+        ::unlink(path.c_str());
+      }
+    } listener{socket_path};
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::snprintf(address.sun_path, sizeof(address.sun_path), "%s", socket_path.c_str());
+    ::unlink(socket_path.c_str());
+    if (listener.fd < 0
+        or ::bind(listener.fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0
+        or ::listen(listener.fd, 16) < 0) {
+      throw std::runtime_error(std::format("Runtime::serve failed to listen on {}, errno:{}",socket_path.string(),errno));
+    }
+
+    // A connection and its session. The session draws to a memory file (ncurses writes, and spins on EAGAIN,
+    // so anything that can fill up could stall every session in doupdate), and its output is sent on to the
+    // client from there without blocking.
+    auto const MAX_PENDING = std::size_t{4*1024*1024}; // Output a client may be behind before it is dropped
+    struct Client {
+      int fd;
+      int relay{::memfd_create("stratoceph-session", MFD_CLOEXEC)}; // Session output, appended and taken after each pump
+      FILE* in{};
+      FILE* out{};
+      std::string pending{}; // Output not yet taken by the client
+      std::unique_ptr<Session> session{};
+
+      explicit Client(int connection) : fd{connection} {
+        if (relay < 0 or ::fcntl(relay, F_SETFL, ::fcntl(relay, F_GETFL) | O_APPEND) < 0) {
+          throw std::runtime_error(std::format("Runtime::serve memfd_create failed, errno:{}",errno));
+        }
+        in = ::fdopen(fd, "r");
+        out = ::fdopen(relay, "w");
+        if (in == nullptr or out == nullptr) {
+          throw std::runtime_error(std::format("Runtime::serve fdopen failed, errno:{}",errno));
+        }
+      }
+      ~Client() {
+        session.reset(); // Before its FILEs
+        if (out != nullptr) std::fclose(out); else if (relay >= 0) ::close(relay);
+        if (in != nullptr) std::fclose(in); else ::close(fd);
+      }
+      Client(Client const&) = delete;
+      Client& operator=(Client const&) = delete;
+
+      // Sends the session output on without blocking. False if the client is gone or max_pending behind.
+      bool flush(std::size_t max_pending) {
+        char buffer[16*1024];
+        off_t taken{};
+        for (ssize_t n{}; (n = ::pread(relay, buffer, sizeof(buffer), taken)) > 0; taken += n) {
+          pending.append(buffer, static_cast<std::size_t>(n));
+        }
+        if (taken > 0 and ::ftruncate(relay, 0) < 0) return false; // The session appends from the start again
+        while (not pending.empty()) {
+          auto const sent = ::send(fd, pending.data(), pending.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+          if (sent < 0) {
+            if (errno == EAGAIN or errno == EWOULDBLOCK or errno == EINTR) break;
+            return false;
+          }
+          pending.erase(0, static_cast<std::size_t>(sent));
+        }
+        return pending.size() <= max_pending;
+      }
+    };
+
+    runtime::Poller poller{};
+    poller.add(listener.fd);
+    std::map<int,std::unique_ptr<Client>> clients{}; // By input fd
+    auto drop = [&](int fd, std::string_view why) {
+      if (auto iter = clients.find(fd); iter != clients.end()) {
+        poller.remove(fd);
+        clients.erase(iter); // Its session removes its own subscription and task fds
+        spdlog::info("Runtime::serve session:{} {}, sessions:{}",fd,why,clients.size());
+      }
+    };
+    while (stop == 0) {
+      std::map<int,std::string_view> ended{}; // Sessions to drop after this turn (and why)
+      // Runs step on the session of fd. A session that throws ends (the others go on)
+      auto guarded = [&ended](int fd, auto&& step) {
+        try {
+          return step();
+        }
+        catch (std::exception const& e) {
+          spdlog::error("Runtime::serve session:{} failed, {}",fd,e.what());
+          ended.emplace(fd, "dropped");
+          return false;
+        }
+      };
+      int timeout_ms{-1};
+      for (auto const& [fd, client] : clients) {
+        auto ms = client->pending.empty() ? client->session->timeout_ms() : 10; // Retry to send the output
+        if (ms >= 0) timeout_ms = (timeout_ms < 0) ? ms : std::min(timeout_ms,ms);
+      }
+      std::set<int> touched{};
+      for (auto fd : poller.wait(timeout_ms)) {
+        if (fd == listener.fd) {
+          if (int connection = ::accept4(listener.fd, nullptr, nullptr, SOCK_CLOEXEC); connection >= 0) {
+            try {
+              auto client = std::make_unique<Client>(connection);
+              client->session = std::make_unique<Session>(*this, poller, client->out, client->in);
+              poller.add(connection);
+              clients.emplace(connection, std::move(client));
+              touched.insert(connection);
+              spdlog::info("Runtime::serve session:{} connected, sessions:{}",connection,clients.size());
+            }
+            catch (std::exception const& e) {
+              spdlog::error("Runtime::serve session:{} failed to start, {}",connection,e.what()); // Client closes connection
+            }
+          }
+        }
+        else if (auto iter = clients.find(fd); iter != clients.end()) {
+          char peek{};
+          if (auto n = ::recv(fd, &peek, 1, MSG_PEEK | MSG_DONTWAIT); n == 0 or (n < 0 and errno != EAGAIN and errno != EWOULDBLOCK and errno != EINTR)) {
+            drop(fd, "disconnected");
+            continue;
+          }
+          if (not ended.contains(fd) and guarded(fd, [&] {iter->second->session->read_input(); return true;})) touched.insert(fd);
+        }
+        else {
+          for (auto& [client_fd, client] : clients) {
+            if (not ended.contains(client_fd) and guarded(client_fd, [&] {return client->session->dispatch(fd);})) {
+              touched.insert(client_fd);
+              break;
+            }
+          }
+        }
+      }
+      for (auto& [fd, client] : clients) {
+        if (ended.contains(fd)) continue;
+        auto& session = *client->session;
+        if ((touched.contains(fd) or session.timeout_ms() == 0) and not guarded(fd, [&session] {return session.pump();})) {
+          ended.emplace(fd, "quit"); // Unless it failed
+        }
+        else if (not client->flush(MAX_PENDING)) {
+          ended.emplace(fd, "dropped (not taking its output)");
+        }
+      }
+      for (auto const& [fd, why] : ended) drop(fd, why);
+    }
+    clients.clear();
+    spdlog::info("Runtime::serve - END");
+    return 0;
+  }
+#endif
+
+private:
+  init_fn m_init;
+  view_fn m_view;
+  update_fn m_update;
+  update_batch_fn m_update_batch;
+  subscriptions_fn m_subscriptions;
+  subscriptions_key_fn m_subscriptions_key{};
+  std::optional<std::filesystem::path> m_snapshot_path{};
+  std::chrono::milliseconds m_snapshot_period{};
+  std::optional<runtime::alloc::Budget> m_allocation_budget{};
+  std::optional<std::size_t> m_frame_memory_bytes{};
+  runtime::Clock::duration m_frame_interval{}; // Zero = render whenever the model changed
+  first_frame_fn m_first_frame{};
+  pump_fn m_pump{};
+
+  // The state of one running client (model, queues, terminal). Driven by run or serve.
+  class Session {
+  public:
+#ifdef __linux__
+    template <typename... Args>
+    Session(Runtime const& app, runtime::Poller& poller, Args&&... backend_args)
+      :  m_app{app}
+        ,m_backend_holder{std::forward<Args>(backend_args)...}
+        ,m_subscriptions{poller}
+        ,m_scheduler{poller} {
+      init();
+    }
+#else
+    template <typename... Args>
+    Session(Runtime const& app, Args&&... backend_args)
+      :  m_app{app}
+        ,m_backend_holder{std::forward<Args>(backend_args)...} {
+      if (m_app.m_subscriptions) spdlog::warn("Runtime::Session - subscriptions not supported on this platform");
+      init();
+    }
+#endif
+
+    Backend& backend() {return m_backend;}
+    int input_fd() const {return m_backend.input_fd();}
+
+    // False when the backend is gone (e.g., its window was closed)
+    bool open() const {
+      if constexpr (requires {{m_backend.open()} -> std::convertible_to<bool>;}) return m_backend.open();
+      else return true;
+    }
+
+    // How often to poll a backend without input_fd (ms)
+    int poll_ms() const {
+      if constexpr (requires {{m_backend.poll_ms()} -> std::convertible_to<int>;}) return m_backend.poll_ms();
+      else return 10;
+    }
+
+    // True when the backend blocks for its input (wait)
+    static constexpr bool waits = requires(Backend& backend) {backend.wait(0);};
+
+    // Blocks at most timeout_ms (-1 = forever) for input
+    void wait(int timeout_ms) {
+      select();
+      if constexpr (requires {m_backend.wait(timeout_ms);}) m_backend.wait(timeout_ms);
+      else std::this_thread::sleep_for(std::chrono::milliseconds{(timeout_ms < 0) ? poll_ms() : std::min(timeout_ms, poll_ms())});
+    }
+
+    // Runs queued input, Cmds and Msgs for at most one frame interval (one of them without a max fps),
+    // advances ready coroutine Cmds one step and renders the final model. Work left over is run by the
+    // next pump (timeout_ms is 0), after the caller has read any new input.
+    // Input goes first, but every pump also runs (at least) the Cmds and Msgs queued before it began,
+    // so a steady stream of input (e.g., key repeat, a replay) never starves the background work.
+    // Returns false when the session got a QUIT msg.
+    bool pump() {
+      select();
+      auto const deadline = runtime::Clock::now() + m_app.m_frame_interval;
+      auto owed = m_cmd_q.size() + m_msg_q.size(); // Background items this pump runs past the deadline
+      while (true) {
+
+        spdlog::info("Runtime::Session loop_count: {}, input_q size: {}, cmd_q size: {}, msg_q size: {}, tasks: {}", m_loop_count,m_input_q.size(),m_cmd_q.size(), m_msg_q.size(), m_scheduler.size());
+        ++m_loop_count;
+
+        if (not m_input_q.empty()) {
+          // Input first (the user never waits behind background Msgs)
+          if (not update(m_input_q)) return false;
+          end_frame();
+        }
+        else if (has_background()) {
+          if (not run_background()) return false;
+          if (owed > 0) --owed;
+        }
+        else break;
+        if (owed == 0 and runtime::Clock::now() >= deadline) break; // Draw, and let input in
+      }
+      // Advance coroutine Cmds (one step each)
+      {
+        runtime::alloc::PhaseScope phase{runtime::alloc::Phase::Cmd};
+        m_scheduler.wake_expired();
+        m_scheduler.run_ready(m_msg_q);
+      }
+      render_if_due();
+      save_snapshot_if_due();
+      if (m_app.m_pump) m_app.m_pump(runtime::QueueDepths{m_input_q.size(),m_msg_q.size(),m_cmd_q.size(),m_scheduler.size()});
+      return true;
+    }
+
+    // How long the session may wait for input (0 when it has work, -1 for no deadline)
+    int timeout_ms() const {
+      if (not m_input_q.empty() or not m_msg_q.empty() or not m_cmd_q.empty() or m_scheduler.has_ready()) return 0;
+      auto result = m_scheduler.timeout_ms();
+      auto until = [&result](runtime::Clock::time_point due) {
+        auto const ms = std::chrono::ceil<std::chrono::milliseconds>(due - runtime::Clock::now()).count();
+        auto const due_ms = static_cast<int>(std::max<decltype(ms)>(ms,0));
+        result = (result < 0) ? due_ms : std::min(result,due_ms);
+      };
+      if (m_render_pending) until(m_last_render + m_app.m_frame_interval);
+      if (m_snapshot_path and m_snapshot_dirty) until(m_last_snapshot + m_snapshot_period);
+      return result;
+    }
+
+    // Restores the model from path (if saved there) and keeps saving it while it changes
+    void enable_snapshot(std::filesystem::path const& path, std::chrono::milliseconds period) {
+      if constexpr (runtime::Snapshottable<Model,Cmd>) {
+        m_snapshot_path = path;
+        m_snapshot_period = period;
+        try {
+          auto restored = m_model;
+          if (auto cmd = runtime::restore_snapshot<Cmd>(path, restored)) {
+            m_model = std::move(restored);
+            push_cmd(*cmd);
+            sync_subscriptions();
+            spdlog::info("Runtime::Session restored snapshot {}",path.string());
+          }
+        }
+        catch (std::exception const& e) {
+          spdlog::warn("Runtime::Session ignored snapshot {}, {}",path.string(),e.what());
+        }
+        m_last_snapshot = runtime::Clock::now();
+      }
+      else {
+        spdlog::warn("Runtime::Session - Model does not implement snapshot save/restore");
+      }
+    }
+
+    // Reads all available keys (type-ahead, paste, replay) without blocking
+    void read_input() {
+      runtime::alloc::PhaseScope phase{runtime::alloc::Phase::Input};
+      select();
+      m_keys.clear();
+      m_backend.read_keys(m_keys);
+      if constexpr (requires {{m_backend.needs_redraw()} -> std::convertible_to<bool>;}) {
+        if (m_backend.needs_redraw()) m_render_pending = true; // The same model again
+      }
+      if (m_keys.empty()) return;
+      if (not m_ui.event_handlers.contains("OnKey")) {
+        throw std::runtime_error(std::format("DESIGN INSUFFICIENCY, Runtime::run failed to find a binding 'OnKey' from client 'view' function"));
+      }
+      for (auto ch : m_keys) {
+        spdlog::info("Runtime::Session ch={}",ch);
+        if (auto pages = scroll_pages(ch); pages != 0 and m_ui.event_handlers.contains("OnScroll")) {
+          on_scroll(pages * page_lines());
+          continue;
+        }
+        Event key_event{{"Key",std::to_string(ch)}};
+        if (auto optional_msg = m_ui.event_handlers["OnKey"](key_event)) m_input_q.push(*optional_msg);
+      }
+    }
+
+    // Serves a ready fd of a coroutine Cmd or subscription. Returns false if fd is not ours
+    bool dispatch(int fd) {
+#ifdef __linux__
+      runtime::alloc::PhaseScope phase{runtime::alloc::Phase::Input};
+      return m_scheduler.dispatch(fd) or m_subscriptions.dispatch(fd, m_msg_q);
+#else
+      return false;
+#endif
+    }
+
+  private:
+    // Makes the backend current (e.g., its ncurses SCREEN or GL context)
+    void select() {
+      if constexpr (requires {m_backend.select();}) m_backend.select();
+    }
+
+    int scroll_pages(int key) const {
+      if constexpr (requires {{m_backend.scroll_pages(key)} -> std::convertible_to<int>;}) return m_backend.scroll_pages(key);
+      else return 0;
+    }
+
+    int page_lines() const {
+      if constexpr (requires {{m_backend.page_lines()} -> std::convertible_to<int>;}) return m_backend.page_lines();
+      else return 10;
+    }
+
+    void on_scroll(int lines) {
+      Event scroll_event{{"Lines",std::to_string(lines)},{"Page",std::to_string(page_lines())}};
+      if (auto optional_msg = m_ui.event_handlers["OnScroll"](scroll_event)) m_input_q.push(*optional_msg);
+    }
+
+    // Tells the view when the page size changed (first render, resized terminal), so it can size its windows
+    void sync_page_lines() {
+      if (auto page = page_lines(); page != m_page_lines) {
+        m_page_lines = page;
+        if (m_ui.event_handlers.contains("OnScroll")) on_scroll(0);
+      }
+    }
+
+    void init() {
+      if (m_app.m_frame_memory_bytes) {
+        runtime::memory::install_pugixml();
+        m_frame_memory.emplace(*m_app.m_frame_memory_bytes);
+      }
+      auto [model, is_quit_msg, cmd] = m_app.m_init();
+      m_model = std::move(model);
+      m_is_quit_msg = is_quit_msg;
+      push_cmd(cmd);
+      sync_subscriptions();
+    }
+
+    bool has_background() const {return not m_cmd_q.empty() or not m_msg_q.empty();}
+
+    // Runs the next queued Cmd, or else the queued Msgs. Returns false on QUIT.
+    bool run_background() {
+      if (not m_cmd_q.empty()) {
+        auto cmd = m_cmd_q.front(); m_cmd_q.pop();
+        execute(cmd);
+      }
+      else if (not update(m_msg_q)) return false;
+      end_frame();
+      return true;
+    }
+
+    void execute(Cmd const& cmd) {
+      runtime::alloc::PhaseScope phase{runtime::alloc::Phase::Cmd};
+      if constexpr (runtime::KeyedCmd<Cmd>) {
+        m_pending_keys.erase(cmd.key());
+        if (cmd.cancelled()) spdlog::info("Runtime::Session dropped cancelled cmd key:{}",cmd.key());
+      }
+      if constexpr (runtime::TaskCmd<Cmd>) {
+        if (auto task = cmd.task(); task and not cmd.cancelled()) m_scheduler.spawn(std::move(*task));
+      }
+      if (auto msg = cmd()) {
+        m_msg_q.push(*msg);
+      }
+    }
+
+    // Runs the queued messages up to any QUIT msg through the client (only one if there is no batch update).
+    // Returns false on QUIT.
+    bool update(std::queue<Msg>& msg_q) {
+      runtime::alloc::PhaseScope phase{runtime::alloc::Phase::Update};
+      auto& batch = m_batch; // Kept, so its capacity is reused
+      batch.clear();
+      bool quit{false};
+      while (not msg_q.empty()) {
+        auto msg = msg_q.front(); msg_q.pop();
+        // Try client provided predicate to identify QUIT msg
+        if (m_is_quit_msg(msg)) {
+          quit = true;
+          break;
+        }
+        batch.push_back(msg);
+        if (not m_app.m_update_batch) break;
+      }
+
+      // Run the message(s) though the client
+      if (batch.size() > 1) {
+        auto [m, cmds] = m_app.m_update_batch(std::move(m_model), std::span<const Msg>(batch));
+        m_model = std::move(m);
+        for (auto const& cmd : cmds) push_cmd(cmd);
+      }
+      else if (batch.size() == 1) {
+        auto [m, cmd] = m_app.m_update(std::move(m_model), batch.front());
+        m_model = std::move(m);
+        push_cmd(cmd);
+      }
+      batch.clear(); // Not kept alive until the next update
+      sync_subscriptions();
+      m_snapshot_dirty = true;
+      m_render_pending = true;
+
+      if (quit) {
+        end_frame();
+        remove_snapshot(); // A clean quit starts over next time
+        return false;
+      }
+      return true;
+    }
+
+    // Renders the model if it changed, at most once per frame interval (only the latest model is drawn)
+    void render_if_due() {
+      auto const now = runtime::Clock::now();
+      if (not m_render_pending or now < m_last_render + m_app.m_frame_interval) return;
+      {
+        runtime::alloc::PhaseScope phase{runtime::alloc::Phase::View};
+        runtime::memory::ResourceScope resource{m_frame_memory ? m_frame_memory->next() : nullptr};
+        replace_ui(m_app.m_view(m_model));
+      }
+      {
+        runtime::alloc::PhaseScope phase{runtime::alloc::Phase::Render};
+        m_backend.render(m_ui.doc, m_ui.texts);
+      }
+      if (m_frames++ == 0) {
+        auto const time_to_first_frame = runtime::Clock::now() - m_started;
+        spdlog::info("Runtime::Session first frame after {}us",std::chrono::duration_cast<std::chrono::microseconds>(time_to_first_frame).count());
+        if (m_app.m_first_frame) m_app.m_first_frame(time_to_first_frame);
+      }
+      m_render_pending = false;
+      m_last_render = now;
+      sync_page_lines();
+      end_frame();
+    }
+
+    // Move constructs (not assigns) ui, so it keeps the allocator (frame arena) it was built with
+    void replace_ui(Html&& ui) {
+      std::destroy_at(&m_ui); // Before its arena is reused (two frames on)
+      std::construct_at(&m_ui, std::move(ui));
+    }
+
+    // Reports the allocations of the frame (since the last call) and checks them against the budget.
+    // The report is made after the frame was counted, and its own allocations are not counted.
+    void end_frame() {
+      if (not m_app.m_allocation_budget) return;
+      auto const frame = runtime::alloc::take();
+      auto const exceeded = m_app.m_allocation_budget->exceeded(frame); // Empty (not allocated) within budget
+      if (not exceeded.empty() and m_app.m_allocation_budget->fail) {
+        throw std::runtime_error(std::format("Runtime::Session frame:{} over allocation budget, {}",m_loop_count,exceeded));
+      }
+      if (spdlog::should_log(spdlog::level::info)) {
+        spdlog::info("Runtime::Session frame:{} allocations {}",m_loop_count,runtime::alloc::to_string(frame));
+      }
+      if (not exceeded.empty()) spdlog::warn("Runtime::Session frame:{} over allocation budget, {}",m_loop_count,exceeded);
+      runtime::alloc::take(); // Drops the report's
+    }
+
+    void push_cmd(Cmd const& cmd) {
+      if (runtime::is_nop(cmd)) return;
+      if constexpr (runtime::BatchCmd<Cmd>) {
+        if (not cmd.parts().empty()) {
+          for (auto const& part : cmd.parts()) push_cmd(part);
+          return;
+        }
+      }
+      if constexpr (runtime::KeyedCmd<Cmd>) {
+        if (cmd.cancelled()) return;
+        if (not cmd.key().empty() and not m_pending_keys.insert(cmd.key()).second) {
+          spdlog::info("Runtime::Session coalesced cmd key:{}",cmd.key());
+          return;
+        }
+      }
+      m_cmd_q.push(cmd);
+    }
+
+    void save_snapshot_if_due() {
+      if constexpr (runtime::Snapshottable<Model,Cmd>) {
+        if (not m_snapshot_path or not m_snapshot_dirty) return;
+        if (auto now = runtime::Clock::now(); now - m_last_snapshot >= m_snapshot_period) {
+          m_last_snapshot = now;
+          try {
+            runtime::save_snapshot(*m_snapshot_path, m_model);
+            m_snapshot_dirty = false;
+          }
+          catch (std::exception const& e) {
+            // E.g., a full disk. The session goes on, and saves again next period.
+            spdlog::warn("Runtime::Session failed to save snapshot {}, {}",m_snapshot_path->string(),e.what());
+          }
+        }
+      }
+    }
+
+    void remove_snapshot() {
+      if (m_snapshot_path) {
+        std::error_code ec{};
+        std::filesystem::remove(*m_snapshot_path, ec);
+      }
+    }
+
+    void sync_subscriptions() {
+#ifdef __linux__
+      if (not m_app.m_subscriptions) return;
+      if (m_app.m_subscriptions_key) {
+        auto const key = m_app.m_subscriptions_key(m_model);
+        if (m_subscriptions_synced and key == m_subscriptions_key) return; // Still the same
+        m_subscriptions_key = key;
+        m_subscriptions_synced = true;
+      }
+      m_subscriptions.sync(m_app.m_subscriptions(m_model));
+#endif
+    }
+
+    Runtime const& m_app;
+    runtime::Clock::time_point m_started{runtime::Clock::now()}; // Before the backend is set up
+    runtime::BackendHolder<Backend> m_backend_holder;
+    Backend& m_backend{m_backend_holder.get()};
+    Model m_model{};
+    runtime::IsQuit<Msg> m_is_quit_msg{};
+    std::optional<runtime::memory::FrameMemory> m_frame_memory{}; // Before m_ui (outlives it)
+    Html m_ui{};
+    std::vector<int> m_keys{}; // Read by the last read_input
+    std::queue<Msg> m_input_q{}; // Served before m_msg_q (background)
+    std::queue<Msg> m_msg_q{};
+    std::vector<Msg> m_batch{}; // The Msgs of an update
+    std::queue<Cmd> m_cmd_q{};
+    std::set<std::string> m_pending_keys{};
+#ifdef __linux__
+    runtime::SubscriptionManager<Msg> m_subscriptions;
+    std::size_t m_subscriptions_key{};
+    bool m_subscriptions_synced{false};
+    runtime::Scheduler<Msg> m_scheduler;
+#else
+    runtime::Scheduler<Msg> m_scheduler{};
+#endif
+    int m_loop_count{};
+    std::size_t m_frames{};
+    int m_page_lines{-1}; // As last told to the view
+    bool m_render_pending{true}; // The model changed since the last render (or nothing rendered yet)
+    runtime::Clock::time_point m_last_render{};
+    std::optional<std::filesystem::path> m_snapshot_path{};
+    std::chrono::milliseconds m_snapshot_period{};
+    runtime::Clock::time_point m_last_snapshot{};
+    bool m_snapshot_dirty{false};
+  };
+};
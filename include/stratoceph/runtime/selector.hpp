@@ -0,0 +1,52 @@
+#pragma once
+// Memoized selectors. A Selector derives data from parts of the model and recomputes it only
+// when its inputs change. Inputs are compared by value, so pass identities and versions
+// (e.g., a State pointer and a row count) rather than the data itself.
+// The result is shared (immutable), so copying a model that holds a Selector is cheap.
+// Selecting is const (the cache is not part of the model's value), e.g. from a view of a const model.
+// Note: Not thread safe, a Selector is used by the thread of its model.
+
+#include <functional>
+#include <memory>
+#include <optional>
+#include <tuple>
+#include <utility>
+
+namespace runtime {
+
+  template <typename Result, typename... Inputs>
+  class Selector {
+  public:
+    using fn_type = std::function<Result(Inputs const&...)>;
+
+    Selector(fn_type fn) : m_fn{std::move(fn)} {}
+
+    // Returns the cached result, recomputed if any input differs from the last call
+    std::shared_ptr<Result const> const& operator()(Inputs const&... inputs) const {
+      if (not m_result or not (*m_inputs == std::tie(inputs...))) {
+        m_result = std::make_shared<Result const>(m_fn(inputs...));
+        m_inputs.emplace(inputs...);
+        ++m_computations;
+      }
+      return m_result;
+    }
+
+    // The last result (null before the first call)
+    std::shared_ptr<Result const> const& get() const {return m_result;}
+
+    // Times the result was (re)computed
+    std::size_t computations() const {return m_computations;}
+
+    void invalidate() {
+      m_result.reset();
+      m_inputs.reset();
+    }
+
+  private:
+    fn_type m_fn;
+    mutable std::optional<std::tuple<Inputs...>> m_inputs{};
+    mutable std::shared_ptr<Result const> m_result{};
+    mutable std::size_t m_computations{};
+  };
+
+} // namespace runtime
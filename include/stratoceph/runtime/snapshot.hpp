@@ -0,0 +1,81 @@
+#pragma once
+// Session snapshots. A Model that implements (found by ADL)
+//   void save(Model const& model, runtime::SnapshotWriter& out)
+//   std::optional<Cmd> restore(Model& model, runtime::SnapshotReader& in) // nullopt = could not restore
+// is saved by the runtime while it changes, and restored on startup.
+// File : "SCSN1", model bytes (see wire/encoding.hpp)
+
+#include <concepts>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include "stratoceph/wire/encoding.hpp"
+
+#if defined(__linux__) or defined(__APPLE__)
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace runtime {
+
+  class SnapshotWriter {
+  public:
+    void varint(std::uint64_t value) {wire::put_varint(m_bytes, value);}
+    void str(std::string_view str) {wire::put_str(m_bytes, str);}
+    std::string const& bytes() const {return m_bytes;}
+  private:
+    std::string m_bytes{};
+  };
+
+  using SnapshotReader = wire::Reader;
+
+  template <typename Model, typename Cmd>
+  concept Snapshottable = requires(Model const& saved, Model& restored, SnapshotWriter& out, SnapshotReader& in) {
+    save(saved, out);
+    {restore(restored, in)} -> std::convertible_to<std::optional<Cmd>>;
+  };
+
+  inline constexpr std::string_view SNAPSHOT_MAGIC{"SCSN1"};
+
+  // Writes the snapshot to a temporary file, synced to disk, and renames it over path (a crash never leaves a torn snapshot)
+  template <typename Model>
+  void save_snapshot(std::filesystem::path const& path, Model const& model) {
+    SnapshotWriter out{};
+    save(model, out);
+    auto temporary = path;
+    temporary += ".tmp";
+    {
+      std::ofstream file{temporary, std::ios::binary | std::ios::trunc};
+      file.write(SNAPSHOT_MAGIC.data(), SNAPSHOT_MAGIC.size());
+      file.write(out.bytes().data(), out.bytes().size());
+      file.close(); // Flushes, a full disk fails here
+      if (not file) throw std::runtime_error(std::format("save_snapshot failed to write {}",temporary.string()));
+    }
+#if defined(__linux__) or defined(__APPLE__)
+    int const fd = ::open(temporary.c_str(), O_RDONLY | O_CLOEXEC);
+    bool const synced = fd >= 0 and ::fsync(fd) == 0;
+    auto const error = errno;
+    if (fd >= 0) ::close(fd);
+    if (not synced) throw std::runtime_error(std::format("save_snapshot failed to sync {}, errno:{}",temporary.string(),error));
+#endif
+    std::filesystem::rename(temporary, path);
+  }
+
+  // Restores model from the snapshot at path. Returns the Cmd to run, or nullopt if there is no (usable) snapshot.
+  template <typename Cmd, typename Model>
+  std::optional<Cmd> restore_snapshot(std::filesystem::path const& path, Model& model) {
+    std::ifstream file{path, std::ios::binary};
+    if (not file) return std::nullopt;
+    std::string const bytes{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+    if (not bytes.starts_with(SNAPSHOT_MAGIC)) return std::nullopt;
+    SnapshotReader in{std::string_view{bytes}.substr(SNAPSHOT_MAGIC.size())};
+    return restore(model, in);
+  }
+
+} // namespace runtime
@@ -0,0 +1,213 @@
+#pragma once
+// Soak runs. A session is driven by scripted keys (e.g., random navigation) for millions of iterations,
+// while a Monitor samples RSS, input to frame latency and queue depths per window of iterations,
+// and fails the run when they grow beyond its Thresholds (leaks, unbounded queues, slowdowns).
+//   runtime::soak::Monitor monitor{thresholds};
+//   runtime::soak::Scripted<runtime::Headless> backend{renderer, script, monitor};
+//   app.on_pump([&monitor](auto const& depths) {monitor.queues(depths);});
+//   app.run(argc, argv, backend);
+// Build with -DSTRATOCEPH_SANITIZE=address (or thread) to also catch memory and threading errors.
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <cstdio>
+#include <format>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <pugixml.hpp>
+#include "stratoceph/runtime/runtime.hpp"
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+namespace runtime::soak {
+
+#if defined(__SANITIZE_ADDRESS__)
+  inline constexpr bool ADDRESS_SANITIZER{true};
+#elif defined(__has_feature)
+  inline constexpr bool ADDRESS_SANITIZER{__has_feature(address_sanitizer)};
+#else
+  inline constexpr bool ADDRESS_SANITIZER{false};
+#endif
+
+  // Resident set size of this process (0 where not available)
+  inline std::size_t rss_bytes() {
+#ifdef __linux__
+    std::size_t pages{}, resident{};
+    if (auto file = std::fopen("/proc/self/statm", "r")) {
+      if (std::fscanf(file, "%zu %zu", &pages, &resident) != 2) resident = 0;
+      std::fclose(file);
+    }
+    return resident * static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+#else
+    return 0;
+#endif
+  }
+
+  struct Thresholds {
+    // Max RSS relative to the baseline window (0 = not checked). Not with ASan, its quarantine holds
+    // freed memory (LeakSanitizer reports leaks at exit instead).
+    double rss_growth{ADDRESS_SANITIZER ? 0.0 : 1.5};
+    double p99_growth{4.0};       // Max p99 latency relative to the baseline window ...
+    double p99_floor_ms{1.0};     // ... when above this (sub-ms jitter is not a slowdown)
+    std::size_t max_queue{1024};  // Max depth of any queue
+    std::size_t warmup_windows{2}; // Windows before the baseline (pools, caches and arenas fill up)
+  };
+
+  // What a window of iterations looked like
+  struct Window {
+    std::size_t iteration{}; // At its end
+    std::size_t rss{};
+    double p50_ms{};
+    double p99_ms{};
+    double max_ms{};
+    runtime::QueueDepths max_queues{};
+  };
+
+  inline std::string to_string(Window const& window) {
+    return std::format("iteration:{:>10} rss:{:>8}KiB latency p50:{:.3f}ms p99:{:.3f}ms max:{:.3f}ms queues input:{} msg:{} cmd:{} tasks:{}"
+      ,window.iteration,window.rss / 1024,window.p50_ms,window.p99_ms,window.max_ms
+      ,window.max_queues.input,window.max_queues.msg,window.max_queues.cmd,window.max_queues.tasks);
+  }
+
+  class Monitor {
+  public:
+    explicit Monitor(Thresholds thresholds = {}, std::size_t window_iterations = 10'000)
+      :  m_thresholds{thresholds}
+        ,m_window_iterations{std::max<std::size_t>(window_iterations,1)} {
+      m_latencies.reserve(m_window_iterations); // No growth of its own while sampling
+    }
+
+    void latency(runtime::Clock::duration input_to_frame) {
+      if (m_latencies.size() < m_latencies.capacity()) {
+        m_latencies.push_back(std::chrono::duration<double,std::milli>(input_to_frame).count());
+      }
+    }
+
+    void queues(runtime::QueueDepths const& depths) {
+      auto& max = m_max_queues;
+      max = {std::max(max.input,depths.input),std::max(max.msg,depths.msg),std::max(max.cmd,depths.cmd),std::max(max.tasks,depths.tasks)};
+    }
+
+    // Counts an iteration, and closes the window after each window_iterations.
+    // Returns false once the run failed (see failure).
+    bool iteration() {
+      if (++m_iteration % m_window_iterations == 0) close_window();
+      return m_failure.empty();
+    }
+
+    std::size_t iterations() const {return m_iteration;}
+    std::vector<Window> const& windows() const {return m_windows;}
+    // Why the run failed (empty while it passes)
+    std::string const& failure() const {return m_failure;}
+
+    // Called with each closed window (e.g., to print progress)
+    void on_window(std::function<void(Window const&)> window_fn) {m_window_fn = std::move(window_fn);}
+
+  private:
+    double percentile(double p) {
+      if (m_latencies.empty()) return 0;
+      auto nth = m_latencies.begin() + static_cast<std::ptrdiff_t>(p * static_cast<double>(m_latencies.size() - 1));
+      std::nth_element(m_latencies.begin(), nth, m_latencies.end());
+      return *nth;
+    }
+
+    void close_window() {
+      Window window{m_iteration, rss_bytes()};
+      window.p50_ms = percentile(0.50);
+      window.p99_ms = percentile(0.99);
+      window.max_ms = m_latencies.empty() ? 0 : *std::max_element(m_latencies.begin(), m_latencies.end());
+      window.max_queues = m_max_queues;
+      m_latencies.clear();
+      m_max_queues = {};
+      m_windows.push_back(window);
+      if (m_window_fn) m_window_fn(window);
+      check(window);
+    }
+
+    void check(Window const& window) {
+      auto const& max = window.max_queues;
+      if (auto deepest = std::max({max.input,max.msg,max.cmd,max.tasks}); deepest > m_thresholds.max_queue) {
+        m_failure = std::format("queue depth {} > {} at iteration {}",deepest,m_thresholds.max_queue,window.iteration);
+        return;
+      }
+      if (m_windows.size() <= m_thresholds.warmup_windows) return;
+      auto const& baseline = m_windows[m_thresholds.warmup_windows];
+      if (m_thresholds.rss_growth > 0 and baseline.rss > 0 and static_cast<double>(window.rss) > m_thresholds.rss_growth * static_cast<double>(baseline.rss)) {
+        m_failure = std::format("rss {}KiB > {} x {}KiB (baseline) at iteration {}",window.rss / 1024,m_thresholds.rss_growth,baseline.rss / 1024,window.iteration);
+      }
+      else if (window.p99_ms > m_thresholds.p99_floor_ms and window.p99_ms > m_thresholds.p99_growth * baseline.p99_ms) {
+        m_failure = std::format("p99 latency {:.3f}ms > {} x {:.3f}ms (baseline) at iteration {}",window.p99_ms,m_thresholds.p99_growth,baseline.p99_ms,window.iteration);
+      }
+    }
+
+    Thresholds m_thresholds;
+    std::size_t m_window_iterations;
+    std::size_t m_iteration{};
+    std::vector<double> m_latencies{};
+    runtime::QueueDepths m_max_queues{};
+    std::vector<Window> m_windows{};
+    std::function<void(Window const&)> m_window_fn{};
+    std::string m_failure{};
+  };
+
+  // A runtime::Backend that draws on a borrowed renderer (e.g., runtime::Headless, or a terminal to soak
+  // its windows too) with keys from a script, and reports the input to frame latency to a Monitor.
+  template <runtime::Renderer R>
+  class Scripted {
+  public:
+    // Appends the next keys. Returns false when done (ends the session).
+    using script_fn = std::function<bool(std::vector<int>& keys)>;
+
+    Scripted(R& renderer, script_fn script, Monitor& monitor)
+      :  m_renderer{renderer}
+        ,m_script{std::move(script)}
+        ,m_monitor{monitor} {}
+
+    void select() {
+      if constexpr (requires {m_renderer.select();}) m_renderer.select();
+    }
+
+    void render(pugi::xml_document const& doc, std::span<std::string_view const> texts = {}) {
+      m_renderer.render(doc, texts);
+      if (m_input_time) {
+        m_monitor.latency(runtime::Clock::now() - *m_input_time);
+        m_input_time.reset();
+      }
+    }
+
+    void read_keys(std::vector<int>& keys) {
+      auto const size = keys.size();
+      m_open = m_script(keys);
+      if (keys.size() > size and not m_input_time) m_input_time = runtime::Clock::now();
+    }
+
+    int input_fd() const {return -1;}
+    int poll_ms() const {return 0;} // Never waits for input
+    bool open() const {return m_open;}
+
+    int page_lines() const {
+      if constexpr (requires {{m_renderer.page_lines()} -> std::convertible_to<int>;}) return m_renderer.page_lines();
+      else return 10;
+    }
+
+    int scroll_pages(int key) const {
+      if constexpr (requires {{m_renderer.scroll_pages(key)} -> std::convertible_to<int>;}) return m_renderer.scroll_pages(key);
+      else return 0;
+    }
+
+  private:
+    R& m_renderer;
+    script_fn m_script;
+    Monitor& m_monitor;
+    bool m_open{true};
+    std::optional<runtime::Clock::time_point> m_input_time{}; // Of the oldest key not yet drawn
+  };
+
+} // namespace runtime::soak
@@ -0,0 +1,267 @@
+#pragma once
+// Elm style subscriptions. The client declares from the model what message
+// sources it listens to, and the runtime multiplexes them all together with
+// terminal input in a single epoll wait (no polling).
+// Note: The multiplexing is Linux only (epoll, timerfd, inotify)
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <functional>
+#include <map>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <variant>
+#include <vector>
+#include <spdlog/spdlog.h>
+
+#ifdef __linux__
+#include <cerrno>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/timerfd.h>
+#endif
+
+namespace runtime {
+
+  // Fires every interval (positive)
+  struct Every {
+    std::chrono::milliseconds interval;
+    bool operator==(Every const&) const = default;
+  };
+
+  // Fires when the file is modified (e.g. a growing log or record file), and when it is created or replaced
+  // (e.g. a rotated log). The file may be missing, but its directory must exist.
+  struct FileWatch {
+    std::filesystem::path path;
+    bool operator==(FileWatch const&) const = default;
+  };
+
+  // Fires when fd is readable. The client owns fd and must consume the input
+  // in on_event (epoll is level triggered).
+  struct FdReadable {
+    int fd;
+    bool operator==(FdReadable const&) const = default;
+  };
+
+  using Source = std::variant<Every,FileWatch,FdReadable>;
+
+  template <typename Msg>
+  struct Subscription {
+    std::string key; // Identity. Kept alive (not re-created) while declared with the same key and source
+    Source source;
+    std::function<std::optional<Msg>()> on_event;
+  };
+
+  template <typename Msg>
+  using Subscriptions = std::vector<Subscription<Msg>>;
+
+#ifdef __linux__
+
+  // Thin epoll wrapper
+  class Poller {
+  public:
+    Poller() : m_epoll_fd{::epoll_create1(EPOLL_CLOEXEC)} {
+      if (m_epoll_fd < 0) {
+        throw std::runtime_error(std::format("Poller: epoll_create1 failed, errno:{}",errno));
+      }
+    }
+    ~Poller() {
+      ::close(m_epoll_fd);
+    }
+    Poller(Poller const&) = delete;
+    Poller& operator=(Poller const&) = delete;
+
+    void add(int fd) {
+      epoll_event ev{};
+      ev.events = EPOLLIN;
+      ev.data.fd = fd;
+      if (::epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        if (errno == EEXIST) {
+          throw std::runtime_error(std::format("Poller: fd:{} is already waited for. An fd is either the input fd, an FdReadable subscription or awaited by Tasks (not several of them)",fd));
+        }
+        throw std::runtime_error(std::format("Poller: failed to add fd:{}, errno:{}",fd,errno));
+      }
+      ++m_size;
+    }
+
+    void remove(int fd) {
+      if (::epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, nullptr) == 0) --m_size;
+    }
+
+    // The fds waited for
+    std::size_t size() const {return m_size;}
+
+    // Blocks at most timeout_ms (-1 = forever) and returns the fds ready for reading
+    std::vector<int> wait(int timeout_ms) {
+      std::vector<int> result{};
+      epoll_event events[16];
+      int n = ::epoll_wait(m_epoll_fd, events, 16, timeout_ms);
+      for (int i=0;i<n;++i) result.push_back(events[i].data.fd);
+      return result; // Empty on timeout or EINTR (e.g. SIGWINCH)
+    }
+
+  private:
+    int m_epoll_fd;
+    std::size_t m_size{};
+  };
+
+  // Keeps the active subscriptions in sync with the ones declared by the model
+  template <typename Msg>
+  class SubscriptionManager {
+  public:
+    SubscriptionManager(Poller& poller) : m_poller{poller} {}
+    ~SubscriptionManager() {
+      for (auto& [key, active] : m_active) close(active);
+    }
+    SubscriptionManager(SubscriptionManager const&) = delete;
+    SubscriptionManager& operator=(SubscriptionManager const&) = delete;
+
+    // Opens the new, and closes the no longer declared, subscriptions (allocates only for new ones)
+    void sync(Subscriptions<Msg> const& subscriptions) {
+      ++m_generation;
+      for (auto const& sub : subscriptions) {
+        if (auto iter = m_active.find(sub.key); iter != m_active.end()) {
+          if (iter->second.sub.source == sub.source) {
+            iter->second.sub.on_event = sub.on_event; // May capture new model data
+            iter->second.generation = m_generation;
+            continue;
+          }
+          close(iter->second);
+          m_active.erase(iter);
+        }
+        if (auto active = open(sub)) {
+          try {
+            m_poller.add(active->fd);
+          }
+          catch (...) {
+            if (active->owns_fd) ::close(active->fd);
+            throw;
+          }
+          m_by_fd[active->fd] = sub.key;
+          m_active.emplace(sub.key, std::move(*active));
+        }
+      }
+      for (auto iter = m_active.begin(); iter != m_active.end();) {
+        if (iter->second.generation == m_generation) {
+          ++iter;
+        }
+        else {
+          close(iter->second);
+          iter = m_active.erase(iter);
+        }
+      }
+    }
+
+    // Consumes the event on fd and queues the resulting Msg (if any). Returns false if fd is not a subscription
+    bool dispatch(int fd, std::queue<Msg>& msg_q) {
+      auto key_iter = m_by_fd.find(fd);
+      if (key_iter == m_by_fd.end()) return false;
+      auto& active = m_active.at(key_iter->second);
+      if (auto watch = std::get_if<FileWatch>(&active.sub.source)) {
+        if (not read_file_events(active, *watch)) return true; // Nothing about the file
+      }
+      else if (active.owns_fd) {
+        // timerfd expiration count. Not needed, just drain it.
+        char buffer[64];
+        while (::read(fd, buffer, sizeof(buffer)) > 0) {}
+      }
+      if (active.sub.on_event) {
+        if (auto msg = active.sub.on_event()) msg_q.push(*msg);
+      }
+      return true;
+    }
+
+  private:
+    struct Active {
+      int fd;
+      bool owns_fd;
+      Subscription<Msg> sub;
+      std::size_t generation; // Of the last sync that declared it
+      int file_watch{-1};     // FileWatch: the inotify watch of the file (-1 while there is no file)
+    };
+
+    static constexpr std::uint32_t FILE_EVENTS{IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF};
+    static constexpr std::uint32_t DIRECTORY_EVENTS{IN_CREATE | IN_MOVED_TO};
+
+    // Nullopt if the source can not be watched (logged, and tried again by the next sync)
+    std::optional<Active> open(Subscription<Msg> const& sub) {
+      Active result{-1, true, sub, m_generation};
+      if (auto every = std::get_if<Every>(&sub.source)) {
+        if (every->interval <= std::chrono::milliseconds::zero()) {
+          throw std::runtime_error(std::format("SubscriptionManager: subscription '{}' has a non-positive interval:{}ms",sub.key,every->interval.count()));
+        }
+        result.fd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (result.fd >= 0) {
+          auto const ns = std::chrono::duration_cast<std::chrono::nanoseconds>(every->interval).count();
+          itimerspec spec{};
+          spec.it_interval.tv_sec = ns / 1'000'000'000;
+          spec.it_interval.tv_nsec = ns % 1'000'000'000;
+          spec.it_value = spec.it_interval;
+          ::timerfd_settime(result.fd, 0, &spec, nullptr);
+        }
+      }
+      else if (auto watch = std::get_if<FileWatch>(&sub.source)) {
+        // The directory too, so a file created (or rotated) later is watched again
+        result.fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        auto const directory = watch->path.has_parent_path() ? watch->path.parent_path() : std::filesystem::path{"."};
+        if (result.fd >= 0 and ::inotify_add_watch(result.fd, directory.c_str(), DIRECTORY_EVENTS) < 0) {
+          spdlog::warn("SubscriptionManager: failed to watch {}, errno:{}",directory.string(),errno);
+          ::close(result.fd);
+          result.fd = -1;
+        }
+        if (result.fd >= 0) result.file_watch = ::inotify_add_watch(result.fd, watch->path.c_str(), FILE_EVENTS); // -1 until created
+      }
+      else if (auto readable = std::get_if<FdReadable>(&sub.source)) {
+        result.fd = readable->fd;
+        result.owns_fd = false;
+      }
+      if (result.fd < 0) return std::nullopt;
+      return result;
+    }
+
+    // Reads the inotify events of a FileWatch, and watches a replaced file again.
+    // Returns true if the file changed, appeared or went away.
+    bool read_file_events(Active& active, FileWatch const& watch) {
+      bool result{false};
+      alignas(inotify_event) char buffer[4096];
+      for (ssize_t n{}; (n = ::read(active.fd, buffer, sizeof(buffer))) > 0;) {
+        for (ssize_t at{}; at < n;) {
+          auto const& event = *reinterpret_cast<inotify_event const*>(buffer + at);
+          at += static_cast<ssize_t>(sizeof(inotify_event) + event.len);
+          if (event.wd == active.file_watch) {
+            result = true;
+            if (event.mask & (IN_MOVE_SELF | IN_DELETE_SELF | IN_IGNORED)) {
+              // Rotated away. The old file is no longer ours (IN_IGNORED follows a delete or unmount by itself).
+              if (not (event.mask & IN_IGNORED)) ::inotify_rm_watch(active.fd, active.file_watch);
+              active.file_watch = -1;
+            }
+          }
+          else if (event.len > 0 and watch.path.filename() == event.name) {
+            result = true; // Created, or moved in, at the path
+          }
+        }
+      }
+      if (active.file_watch < 0) active.file_watch = ::inotify_add_watch(active.fd, watch.path.c_str(), FILE_EVENTS);
+      return result;
+    }
+
+    void close(Active const& active) {
+      m_poller.remove(active.fd);
+      m_by_fd.erase(active.fd);
+      if (active.owns_fd) ::close(active.fd);
+    }
+
+    Poller& m_poller;
+    std::map<std::string,Active> m_active{};
+    std::map<int,std::string> m_by_fd{};
+    std::size_t m_generation{};
+  };
+
+#endif // __linux__
+
+} // namespace runtime
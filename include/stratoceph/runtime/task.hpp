@@ -0,0 +1,277 @@
+#pragma once
+// Coroutine commands. A Task is scheduled by the runtime event loop (no extra threads) and may
+//   co_yield msg                        - deliver a Msg and continue on the next loop turn
+//   co_await runtime::sleep_for(ms)     - resume after a delay
+//   co_await runtime::readable(fd)      - resume when fd is readable (the task reads it)
+//   co_await task                       - run another Task (its yields and waits included) and resume when it is done
+//   co_await cmd                        - run a Cmd inline (on the loop thread) and get its std::optional<Msg>
+
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include <map>
+#include <optional>
+#include <queue>
+#include <stop_token>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+#include "stratoceph/runtime/subscriptions.hpp" // Poller
+
+namespace runtime {
+
+  using Clock = std::chrono::steady_clock;
+
+  struct SleepFor {
+    std::chrono::milliseconds duration;
+  };
+
+  struct Readable {
+    int fd;
+  };
+
+  inline SleepFor sleep_for(std::chrono::milliseconds duration) {return {duration};}
+  inline Readable readable(int fd) {return {fd};}
+
+  template <typename Msg>
+  class Task {
+  public:
+    // Ready (monostate), sleeping until a time_point or waiting for a readable fd
+    using Wait = std::variant<std::monostate,Clock::time_point,int>;
+
+    struct promise_type {
+      std::optional<Msg> m_yielded{};
+      Wait m_wait{};
+      std::exception_ptr m_exception{};
+      std::coroutine_handle<promise_type> m_child{};  // The Task it awaits (if any)
+      std::coroutine_handle<promise_type> m_parent{}; // The Task awaiting it (if any)
+
+      promise_type() = default; // Not an aggregate (would be initialized from the coroutine arguments)
+
+      Task get_return_object() {
+        return Task{std::coroutine_handle<promise_type>::from_promise(*this)};
+      }
+      std::suspend_always initial_suspend() noexcept {return {};} // Started by the scheduler
+      std::suspend_always final_suspend() noexcept {return {};}
+      std::suspend_always yield_value(Msg msg) {
+        m_yielded = std::move(msg);
+        return {};
+      }
+      void return_void() {}
+      void unhandled_exception() {m_exception = std::current_exception();}
+
+      auto await_transform(SleepFor sleep) {
+        struct Awaiter {
+          promise_type& m_promise;
+          Clock::time_point m_deadline;
+          bool await_ready() const noexcept {return m_deadline <= Clock::now();}
+          void await_suspend(std::coroutine_handle<>) noexcept {m_promise.m_wait = m_deadline;}
+          void await_resume() const noexcept {}
+        };
+        return Awaiter{*this,Clock::now() + sleep.duration};
+      }
+
+      auto await_transform(Readable readable) {
+        struct Awaiter {
+          promise_type& m_promise;
+          int m_fd;
+          bool await_ready() const noexcept {return false;}
+          void await_suspend(std::coroutine_handle<>) noexcept {m_promise.m_wait = m_fd;}
+          void await_resume() const noexcept {}
+        };
+        return Awaiter{*this,readable.fd};
+      }
+
+      // Resumed when child is done (rethrows what child threw). The child is owned by the awaiter, in this frame.
+      auto await_transform(Task&& child) {
+        struct Awaiter {
+          Task m_child;
+          bool await_ready() const noexcept {return m_child.done();} // Nothing to run (e.g., moved out)
+          void await_suspend(std::coroutine_handle<promise_type> parent) noexcept {
+            parent.promise().m_child = m_child.m_handle;
+            m_child.m_handle.promise().m_parent = parent;
+          }
+          void await_resume() {
+            if (not m_child.m_handle) return;
+            if (auto parent = m_child.m_handle.promise().m_parent) parent.promise().m_child = {};
+            if (auto exception = std::exchange(m_child.m_handle.promise().m_exception,{})) std::rethrow_exception(exception);
+          }
+        };
+        return Awaiter{std::move(child)};
+      }
+
+      template <typename F>
+        requires std::is_invocable_r_v<std::optional<Msg>,F&>
+      auto await_transform(F&& cmd) {
+        struct Awaiter {
+          std::optional<Msg> m_result;
+          bool await_ready() const noexcept {return true;}
+          void await_suspend(std::coroutine_handle<>) noexcept {}
+          std::optional<Msg> await_resume() {return std::move(m_result);}
+        };
+        return Awaiter{cmd()};
+      }
+    };
+
+    Task(Task&& other) noexcept : m_handle{std::exchange(other.m_handle,{})}, m_token{std::move(other.m_token)} {}
+    Task& operator=(Task&& other) noexcept {
+      if (this != &other) {
+        if (m_handle) m_handle.destroy();
+        m_handle = std::exchange(other.m_handle,{});
+        m_token = std::move(other.m_token);
+      }
+      return *this;
+    }
+    Task(Task const&) = delete;
+    Task& operator=(Task const&) = delete;
+    ~Task() {
+      if (m_handle) m_handle.destroy();
+    }
+
+    // True when finished, or empty (moved out)
+    bool done() const {return not m_handle or m_handle.done();}
+
+    // The scheduler drops the Task (at its next step) once a stop is requested on token
+    void stop_on(std::stop_token token) {m_token = std::move(token);}
+    bool stopped() const {return m_token.stop_requested();}
+
+    // Runs one step of the innermost awaited Task. An awaited Task that finishes resumes its parent in the same step.
+    void resume() {
+      auto handle = current();
+      while (true) {
+        handle.promise().m_wait = std::monostate{};
+        handle.resume();
+        if (handle == m_handle or not handle.done()) break;
+        handle = handle.promise().m_parent;
+      }
+      if (auto exception = std::exchange(m_handle.promise().m_exception,{})) std::rethrow_exception(exception);
+    }
+
+    std::optional<Msg> take_yielded() {return std::exchange(current().promise().m_yielded,std::nullopt);}
+    Wait const& wait() const {return current().promise().m_wait;}
+
+  private:
+    explicit Task(std::coroutine_handle<promise_type> handle) : m_handle{handle} {}
+
+    // The innermost awaited Task (this one if it awaits none)
+    std::coroutine_handle<promise_type> current() const {
+      auto result = m_handle;
+      while (result.promise().m_child) result = result.promise().m_child;
+      return result;
+    }
+
+    std::coroutine_handle<promise_type> m_handle;
+    std::stop_token m_token{};
+  };
+
+  // Runs Tasks on the runtime loop thread, one step (to the next co_yield / co_await) at a time
+  template <typename Msg>
+  class Scheduler {
+  public:
+    Scheduler() = default;
+#ifdef __linux__
+    Scheduler(Poller& poller) : m_poller{&poller} {}
+    ~Scheduler() {
+      // The poller may outlive this (e.g., a server session)
+      if (m_poller != nullptr) for (auto const& [fd, tasks] : m_reading) m_poller->remove(fd);
+    }
+#endif
+    Scheduler(Scheduler const&) = delete;
+    Scheduler& operator=(Scheduler const&) = delete;
+
+    // Ignores an empty Task (e.g., moved out by a copy of its Cmd that already ran)
+    void spawn(Task<Msg>&& task) {
+      if (task.done()) return;
+      m_ready.push_back(std::move(task));
+    }
+
+    bool has_ready() const {return not m_ready.empty();}
+    std::size_t size() const {
+      auto result = m_ready.size() + m_sleeping.size();
+      for (auto const& [fd, tasks] : m_reading) result += tasks.size();
+      return result;
+    }
+
+    // Advances each ready Task one step and queues the Msgs they yield. Drops stopped Tasks.
+    // A Task that throws is dropped, and the first exception is rethrown after all the others ran their step.
+    void run_ready(std::queue<Msg>& msg_q) {
+      auto ready = std::move(m_ready);
+      m_ready.clear();
+      std::exception_ptr exception{};
+      for (auto& task : ready) {
+        if (task.stopped()) continue;
+        try {
+          task.resume();
+        }
+        catch (...) {
+          if (not exception) exception = std::current_exception();
+          continue;
+        }
+        if (auto msg = task.take_yielded()) msg_q.push(*msg);
+        park(std::move(task));
+      }
+      if (exception) std::rethrow_exception(exception);
+    }
+
+    // Milliseconds to the next sleeping Task deadline (-1 if none)
+    int timeout_ms() const {
+      if (m_sleeping.empty()) return -1;
+      auto next = m_sleeping.front().first;
+      for (auto const& [deadline, task] : m_sleeping) next = std::min(next,deadline);
+      auto const ms = std::chrono::ceil<std::chrono::milliseconds>(next - Clock::now()).count();
+      return static_cast<int>(std::max<decltype(ms)>(ms,0));
+    }
+
+    void wake_expired() {
+      auto const now = Clock::now();
+      for (auto iter = m_sleeping.begin(); iter != m_sleeping.end();) {
+        if (iter->first <= now) {
+          m_ready.push_back(std::move(iter->second));
+          iter = m_sleeping.erase(iter);
+        }
+        else ++iter;
+      }
+    }
+
+    // Wakes the Tasks waiting for fd. Returns false if no Task waits for fd
+    bool dispatch(int fd) {
+      auto iter = m_reading.find(fd);
+      if (iter == m_reading.end()) return false;
+#ifdef __linux__
+      m_poller->remove(fd);
+#endif
+      for (auto& task : iter->second) m_ready.push_back(std::move(task));
+      m_reading.erase(iter);
+      return true;
+    }
+
+  private:
+    void park(Task<Msg>&& task) {
+      if (task.done()) return;
+      if (auto deadline = std::get_if<Clock::time_point>(&task.wait())) {
+        m_sleeping.emplace_back(*deadline,std::move(task));
+      }
+      else if (auto fd = std::get_if<int>(&task.wait()); fd != nullptr and m_poller != nullptr) {
+        auto& waiting = m_reading[*fd];
+#ifdef __linux__
+        if (waiting.empty()) m_poller->add(*fd); // Note: fd must not be watched by anyone but Tasks
+#endif
+        waiting.push_back(std::move(task));
+      }
+      else {
+        m_ready.push_back(std::move(task)); // No poller - readable(fd) degrades to a yield
+      }
+    }
+
+#ifdef __linux__
+    Poller* m_poller{};
+#else
+    void* m_poller{};
+#endif
+    std::vector<Task<Msg>> m_ready{};
+    std::vector<std::pair<Clock::time_point,Task<Msg>>> m_sleeping{};
+    std::map<int,std::vector<Task<Msg>>> m_reading{}; // By the fd they wait for
+  };
+
+} // namespace runtime
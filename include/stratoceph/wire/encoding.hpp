@@ -0,0 +1,54 @@
+#pragma once
+// Compact binary encoding primitives
+// varint : LEB128 (7 bits per byte, least significant first)
+// str    : varint size, bytes
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace wire {
+
+  inline void put_varint(std::string& out, std::uint64_t value) {
+    while (value >= 0x80) {
+      out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+      value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+  }
+
+  inline void put_str(std::string& out, std::string_view str) {
+    put_varint(out, str.size());
+    out.append(str);
+  }
+
+  // Reads from in. Throws std::runtime_error on truncated or malformed input
+  class Reader {
+  public:
+    Reader(std::string_view in) : m_in{in} {}
+    bool empty() const {return m_pos >= m_in.size();}
+    std::size_t remaining() const {return m_in.size() - m_pos;}
+    std::uint64_t varint() {
+      std::uint64_t result{};
+      for (int shift = 0; shift < 64; shift += 7) {
+        if (empty()) throw std::runtime_error("wire::Reader truncated varint");
+        auto byte = static_cast<std::uint8_t>(m_in[m_pos++]);
+        result |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) return result;
+      }
+      throw std::runtime_error("wire::Reader malformed varint");
+    }
+    std::string str() {
+      auto size = varint();
+      if (size > m_in.size() - m_pos) throw std::runtime_error("wire::Reader truncated string");
+      std::string result{m_in.substr(m_pos,size)};
+      m_pos += size;
+      return result;
+    }
+  private:
+    std::string_view m_in;
+    std::size_t m_pos{};
+  };
+
+} // namespace wire
@@ -0,0 +1,301 @@
+#pragma once
+// Compact binary wire protocol for Html_Msg view documents.
+// A heavy backend runs the model and sends each rendered view as a delta to the previous one,
+// a thin client applies the deltas and renders the document locally (e.g., with html_msg_ncurses).
+//
+// Message  : varint payload size, payload
+// Payload  : varint node count, varint change count, change*
+// Change   : varint node index, node
+// Node     : varint depth, str name, varint attribute count, (str name, str value)*, str text
+// str      : varint size, bytes
+// Nodes are the element nodes of the document in document order. A frame with fewer nodes
+// than the previous one truncates it. The first node (the root) has depth 0, every other one
+// a depth from 1 to the depth of the node before it + 1.
+// The client sends its key codes back as varints.
+
+#include <cstdint>
+#include <format>
+#include <limits>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <pugixml.hpp>
+#include <poll.h>
+#include <unistd.h>
+#include "stratoceph/wire/encoding.hpp"
+#include <cerrno>
+
+namespace html_msg_wire {
+
+  struct Node {
+    std::size_t depth{};
+    std::string name{};
+    std::vector<std::pair<std::string,std::string>> attributes{};
+    std::string text{};
+    bool operator==(Node const&) const = default;
+  };
+
+  using Frame = std::vector<Node>;
+
+  // Flattens the element nodes of doc (document order). Text referenced by a 'data-text' index is inlined.
+  inline Frame to_frame(pugi::xml_document const& doc, std::span<std::string_view const> texts = {}) {
+    Frame result{};
+    auto flatten = [&result,texts](auto const& self, pugi::xml_node const& node, std::size_t depth) -> void {
+      for (auto const& child : node.children()) {
+        if (child.type() != pugi::node_element) continue;
+        Node entry{depth, child.name(), {}, child.text().get()};
+        for (auto const& attribute : child.attributes()) {
+          if (std::string_view{attribute.name()} == "data-text" and attribute.as_uint() < texts.size()) {
+            entry.text = texts[attribute.as_uint()];
+          }
+          else entry.attributes.emplace_back(attribute.name(),attribute.value());
+        }
+        result.push_back(std::move(entry));
+        self(self, child, depth+1);
+      }
+    };
+    flatten(flatten, doc, 0);
+    return result;
+  }
+
+  // Rebuilds doc from frame
+  inline void to_document(Frame const& frame, pugi::xml_document& doc) {
+    doc.reset();
+    std::vector<pugi::xml_node> parents{doc};
+    for (auto const& entry : frame) {
+      parents.resize(std::min(parents.size(),entry.depth+1));
+      auto node = parents.back().append_child(entry.name.c_str());
+      for (auto const& [name, value] : entry.attributes) node.append_attribute(name.c_str()) = value.c_str();
+      if (not entry.text.empty()) node.text().set(entry.text.c_str());
+      parents.push_back(node);
+    }
+  }
+
+  inline void put_node(std::string& out, Node const& node) {
+    wire::put_varint(out, node.depth);
+    wire::put_str(out, node.name);
+    wire::put_varint(out, node.attributes.size());
+    for (auto const& [name, value] : node.attributes) {
+      wire::put_str(out, name);
+      wire::put_str(out, value);
+    }
+    wire::put_str(out, node.text);
+  }
+
+  inline Node read_node(wire::Reader& reader) {
+    Node result{};
+    result.depth = reader.varint();
+    result.name = reader.str();
+    auto count = reader.varint();
+    for (std::uint64_t i=0;i<count;++i) {
+      auto name = reader.str();
+      result.attributes.emplace_back(std::move(name),reader.str());
+    }
+    result.text = reader.str();
+    return result;
+  }
+
+  // Encodes documents as deltas to the previously encoded one
+  class Encoder {
+  public:
+    // Returns the complete message (size prefixed)
+    std::string encode(pugi::xml_document const& doc, std::span<std::string_view const> texts = {}) {
+      auto frame = to_frame(doc, texts);
+      std::string payload{};
+      std::vector<std::size_t> changed{};
+      for (std::size_t i=0;i<frame.size();++i) {
+        if (i >= m_previous.size() or not (frame[i] == m_previous[i])) changed.push_back(i);
+      }
+      wire::put_varint(payload, frame.size());
+      wire::put_varint(payload, changed.size());
+      for (auto i : changed) {
+        wire::put_varint(payload, i);
+        put_node(payload, frame[i]);
+      }
+      m_previous = std::move(frame);
+      std::string result{};
+      wire::put_varint(result, payload.size());
+      result.append(payload);
+      return result;
+    }
+    // Next encode sends the whole document (e.g., a client (re)connected)
+    void reset() {m_previous.clear();}
+  private:
+    Frame m_previous{};
+  };
+
+  // Applies messages from an Encoder
+  class Decoder {
+  public:
+    // Bounds on untrusted input (a view document is far smaller)
+    static constexpr std::uint64_t MAX_PAYLOAD{64 << 20};
+    static constexpr std::uint64_t MAX_NODES{1 << 20};
+
+    // Applies one payload (without its size prefix)
+    void apply(std::string_view payload) {
+      wire::Reader reader{payload};
+      auto size = reader.varint();
+      if (size > MAX_NODES) throw std::runtime_error(std::format("html_msg_wire::Decoder node count:{} > {}",size,MAX_NODES));
+      m_frame.resize(size);
+      auto changes = reader.varint();
+      for (std::uint64_t i=0;i<changes;++i) {
+        auto index = reader.varint();
+        if (index >= size) throw std::runtime_error(std::format("html_msg_wire::Decoder node index:{} out of range:{}",index,size));
+        m_frame[index] = read_node(reader);
+      }
+      for (std::size_t i=0;i<m_frame.size();++i) {
+        auto const depth = m_frame[i].depth;
+        if ((i == 0) ? depth != 0 : (depth == 0 or depth > m_frame[i-1].depth + 1)) {
+          throw std::runtime_error(std::format("html_msg_wire::Decoder node:{} depth:{} after depth:{}",i,depth,(i == 0) ? 0 : m_frame[i-1].depth));
+        }
+      }
+    }
+
+    // Buffers received bytes. Returns the payload of the next complete message (if any).
+    // Throws std::runtime_error on a malformed size prefix or a payload larger than MAX_PAYLOAD.
+    std::optional<std::string> next_payload(std::string_view received = {}) {
+      m_buffer.append(received);
+      std::size_t pos{};
+      std::uint64_t size{};
+      for (int shift = 0; pos < m_buffer.size(); shift += 7) {
+        if (shift >= 64) throw std::runtime_error("html_msg_wire::Decoder malformed payload size");
+        auto byte = static_cast<std::uint8_t>(m_buffer[pos++]);
+        size |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+          if (size > MAX_PAYLOAD) throw std::runtime_error(std::format("html_msg_wire::Decoder payload size:{} > {}",size,MAX_PAYLOAD));
+          if (m_buffer.size() - pos < size) return std::nullopt;
+          auto result = m_buffer.substr(pos,size);
+          m_buffer.erase(0,pos+size);
+          return result;
+        }
+      }
+      return std::nullopt;
+    }
+
+    Frame const& frame() const {return m_frame;}
+  private:
+    Frame m_frame{};
+    std::string m_buffer{};
+  };
+
+  // Sends rendered documents to a remote client over fd (pipe, Unix socket), and reads its keys
+  // from input_fd (e.g., the same socket). A runtime::Backend.
+  class RemoteRenderer {
+  public:
+    RemoteRenderer(int fd, int input_fd = -1) : m_fd{fd}, m_input_fd{input_fd} {}
+    void render(pugi::xml_document const& doc, std::span<std::string_view const> texts = {}) {
+      auto message = m_encoder.encode(doc, texts);
+      std::string_view pending{message};
+      while (not pending.empty()) {
+        auto written = ::write(m_fd, pending.data(), pending.size());
+        if (written < 0) {
+          if (errno == EINTR) continue;
+          throw std::runtime_error(std::format("html_msg_wire::RemoteRenderer write failed, errno:{}",errno));
+        }
+        pending.remove_prefix(written);
+      }
+    }
+
+    int input_fd() const {return m_input_fd;}
+    bool open() const {return m_open;}
+
+    // Appends the keys received without blocking. A malformed key ends the connection (as if the client hung up).
+    void read_keys(std::vector<int>& keys) {
+      if (m_input_fd < 0 or not m_open) return;
+      pollfd ready{m_input_fd, POLLIN, 0};
+      char buffer[256];
+      while (::poll(&ready, 1, 0) > 0) {
+        auto received = ::read(m_input_fd, buffer, sizeof(buffer));
+        if (received < 0 and errno == EINTR) continue;
+        if (received <= 0) {
+          m_open = false; // Client hung up
+          break;
+        }
+        m_received.append(buffer, received);
+      }
+      // Complete varints only (a key may be split over reads)
+      std::size_t pos{};
+      try {
+        while (true) {
+          auto end = pos;
+          while (end < m_received.size() and (static_cast<std::uint8_t>(m_received[end]) & 0x80)) ++end;
+          if (end >= m_received.size()) {
+            if (end - pos > MAX_KEY_BYTES) throw std::runtime_error("html_msg_wire::RemoteRenderer malformed key");
+            break;
+          }
+          wire::Reader reader{std::string_view{m_received}.substr(pos, end + 1 - pos)};
+          auto const key = reader.varint();
+          if (key > static_cast<std::uint64_t>(std::numeric_limits<int>::max())) {
+            throw std::runtime_error(std::format("html_msg_wire::RemoteRenderer key:{} out of range",key));
+          }
+          keys.push_back(static_cast<int>(key));
+          pos = end + 1;
+        }
+      }
+      catch (std::runtime_error const&) {
+        m_open = false; // Protocol error, the client is dropped
+        m_received.clear();
+        return;
+      }
+      m_received.erase(0, pos);
+    }
+
+  private:
+    static constexpr std::size_t MAX_KEY_BYTES{10}; // The longest varint
+    int m_fd;
+    int m_input_fd;
+    bool m_open{true};
+    std::string m_received{};
+    Encoder m_encoder{};
+  };
+
+  // Thin client. Reads messages from fd and renders each frame with renderer (until fd is closed).
+  // A renderer that also reads keys (a runtime::Backend, e.g. html_msg_ncurses::Renderer) has them sent back over fd.
+  template <typename Renderer>
+  void render_remote(int fd, Renderer& renderer) {
+    Decoder decoder{};
+    pugi::xml_document doc{};
+    char buffer[4096];
+    constexpr bool sends_keys = requires(std::vector<int>& keys) {
+      renderer.read_keys(keys);
+      renderer.input_fd();
+    };
+    std::vector<int> keys{};
+    std::vector<pollfd> ready{{fd, POLLIN, 0}};
+    if constexpr (sends_keys) ready.push_back({renderer.input_fd(), POLLIN, 0});
+    while (true) {
+      if (::poll(ready.data(), ready.size(), -1) < 0) {
+        if (errno == EINTR) continue;
+        break;
+      }
+      if constexpr (sends_keys) {
+        if (ready[1].revents & POLLIN) {
+          keys.clear();
+          renderer.read_keys(keys);
+          std::string message{};
+          for (auto key : keys) wire::put_varint(message, static_cast<std::uint64_t>(key));
+          if (not message.empty() and ::write(fd, message.data(), message.size()) < 0) break;
+        }
+      }
+      if ((ready[0].revents & (POLLIN | POLLHUP)) == 0) continue;
+      auto received = ::read(fd, buffer, sizeof(buffer));
+      if (received < 0 and errno == EINTR) continue;
+      if (received <= 0) break;
+      bool updated{false};
+      for (auto payload = decoder.next_payload({buffer,static_cast<std::size_t>(received)}); payload; payload = decoder.next_payload()) {
+        decoder.apply(*payload);
+        updated = true;
+      }
+      if (updated) {
+        // Only the last frame of a burst is drawn
+        to_document(decoder.frame(), doc);
+        renderer.render(doc);
+      }
+    }
+  }
+
+} // namespace html_msg_wire
@@ -13,508 +13,243 @@
 #include <stack>
 #include <functional>
 #include <queue>
+#include <span>
+#include <stop_token>
+#include <format>
 #include <filesystem>
-#include <cmath>  // std::pow,...
+#include <fstream>
+#include <array>
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+#include <charconv>
+#include <chrono>
+#include <thread>
 #include <immer/vector.hpp>
+#include <spdlog/sinks/dist_sink.h>
+#include <spdlog/sinks/ringbuffer_sink.h>
+#include <random>
+#include "stratoceph/runtime/headless.hpp"
+#include "stratoceph/runtime/soak.hpp"
+#include <unistd.h>
+
+#include "first.hpp"
 
 namespace first {
 
-    // Splits a size_t range into mod10 sub-ranges
-    struct Mod10View {
-      using Range = std::pair<size_t,size_t>;
-      Range m_range;
-      size_t m_subrange_size;
-  
-      Mod10View(Range range)
-        :  m_range{range}
-          ,m_subrange_size{static_cast<size_t>(std::pow(10,std::ceil(std::log10(range.second-range.first))-1))} {}
-  
-      template <class T>
-      Mod10View(T const& container) : Mod10View(Range(0,container.size())) {}
-  
-      // return vector of [begin,end[
-      std::vector<Range> subranges() {
-        std::vector<std::pair<size_t,size_t>> result{};
-        for (size_t i=m_range.first;i<m_range.second;i += m_subrange_size) {
-          result.push_back(std::make_pair(i,std::min(i+m_subrange_size,m_range.second)));
-        }
-        return result;
-      }
-    };
-  
-    // ----------------------------------
-    // Begin: Forward State
-    // ----------------------------------
-  
-    struct StateImpl; // Forward
-    using State = std::shared_ptr<StateImpl>;
-  
-    // ----------------------------------
-    // End: Forward State
-    // ----------------------------------
-  
-    // ----------------------------------
-    // Begin: Message
-    // ----------------------------------
-  
-    struct MsgImpl {
-      virtual ~MsgImpl() = default;
-    };
-  
-    using Msg = std::shared_ptr<MsgImpl>;
-  
-    struct NCursesKey : public MsgImpl {
-      int key;
-      NCursesKey(int key) : key{key}, MsgImpl{} {}
-    };
-  
-    struct Quit : public MsgImpl {};
-  
-    struct PushStateMsg : public MsgImpl {
-      State m_parent{};
-      State m_state{};
-      PushStateMsg(State const& parent,State const& state)
-        :  m_parent{parent}
-          ,m_state{state} {}
-    };
-  
-    Msg const QUIT_MSG{std::make_shared<Quit>()};
-  
-    // ----------------------------------
-    // END: Message
-    // ----------------------------------
-  
-    // ----------------------------------
-    // Begin: Subscription
-    // ----------------------------------
-  
-    std::optional<Msg> onKey(Event event) {
-      if (event.contains("Key")) {
-        return Msg{std::make_shared<NCursesKey>(std::stoi(event["Key"]))};
-      }
-      return std::nullopt;
+  // Prints the time to build rows for 10^3 .. 10^7 entries (example --bench-rows)
+  int bench_rows() {
+    for (size_t size=1000;size<=10'000'000;size *= 10) {
+      std::vector<std::string> names(size);
+      for (size_t i=0;i<size;++i) names[i] = "RBD #" + std::to_string(i);
+      auto const start = std::chrono::steady_clock::now();
+      auto rows = build_rows(names,0,size);
+      auto const build_ms = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
+      std::cout << std::format("rows:{:>9} build_rows:{:>9.2f} ms subranges:{}\n",size,build_ms,RangePartition(names).count());
     }
-  
-    // ----------------------------------
-    // End: Subscription
-    // ----------------------------------
-  
-    // ----------------------------------
-    // Begin: Command
-    // ----------------------------------
-  
-    using Cmd = std::function<std::optional<Msg>()>;
-  
-    std::optional<Msg> Nop() {
-      return std::nullopt;
-    };
-  
-    std::optional<Msg> DO_QUIT() {
-      return QUIT_MSG;
-    };
-  
-    // ----------------------------------
-    // End: Command
-    // ----------------------------------
-  
-    using StateFactory = std::function<State()>;
-  
-    // ----------------------------------
-    // Begin: Model
-    // ----------------------------------
-  
-    struct StateImpl {
-    private:
-    public:
-      using UX = std::vector<std::string>;
-      using Options = std::map<char,std::pair<std::string,StateFactory>>;
-      UX m_ux;
-      Options m_options;
-      StateImpl(UX const& ux) : m_ux{ux},m_options{} {}
-      void add_option(char ch,std::pair<std::string,StateFactory> option) {
-        m_options[ch] = option;
-      }
-      UX const& ux() const {return m_ux;}
-      UX& ux() {return m_ux;}
-      Options const& options() const {return m_options;}
-      virtual std::pair<std::optional<State>,Cmd> update(Msg const& msg) {
-        return {std::nullopt,Nop}; // Default - no StateImpl mutation
-      }
-    };
-     
-    struct RBDState : public StateImpl {
-      StateFactory SIE_factory = []() {
-        auto SIE_ux = StateImpl::UX{
-          "RBD to SIE UX goes here"
-        };
-        return std::make_shared<StateImpl>(SIE_ux);
-      };
-      using RBD = std::string;
-      RBD m_rbd;
-      RBDState(RBD rbd) : m_rbd{rbd} ,StateImpl({}) {
-        ux().clear();
-        ux().push_back(rbd);
-        this->add_option('0',{"RBD -> SIE",SIE_factory});
-      }
-    };
-  
-    struct RBDsState : public StateImpl {
-  
-      using RBDs = std::vector<std::string>;
-      RBDsState::RBDs m_all_rbds;
-      Mod10View m_mod10_view;
-  
-      struct RBDs_subrange_factory {
-        // RBD subrange StateImpl factory
-        RBDsState::RBDs m_all_rbds{};
-        Mod10View m_mod10_view;
-  
-        auto operator()() {return std::make_shared<RBDsState>(m_all_rbds,m_mod10_view);}
-  
-        RBDs_subrange_factory(RBDsState::RBDs all_rbds, Mod10View mod10_view)
-          :  m_mod10_view{mod10_view}            
-            ,m_all_rbds{all_rbds} {} 
-      };
-  
-      RBDsState(RBDs all_rbds,Mod10View mod10_view)
-        :  m_mod10_view{mod10_view}
-          ,m_all_rbds{all_rbds}
-          ,StateImpl({}) {
-  
-        auto subranges = m_mod10_view.subranges();
-        for (size_t i=0;i<subranges.size();++i) {
-          auto const subrange = subranges[i];
-          auto const& [begin,end] = subrange;
-          auto caption = std::to_string(begin);
-          if (end-begin==1) {
-            // Single RBD in range option
-            this->add_option(static_cast<char>('0'+i),{caption,[rbd=m_all_rbds[begin]](){
-              // Single RBT factory
-              auto RBD_ux = StateImpl::UX{
-                "RBD UX goes here"
-              };
-              return std::make_shared<RBDState>(rbd);
-            }});
-          }
-          else {
-            caption += " .. ";
-            caption += std::to_string(end-1);
-            this->add_option(static_cast<char>('0'+i),{caption,RBDs_subrange_factory(m_all_rbds,subrange)});
-          }
-        }
-  
-        // Initiate view UX
-        for (size_t i=m_mod10_view.m_range.first;i<m_mod10_view.m_range.second;++i) {
-          auto entry = std::to_string(i);
-          entry += ". ";
-          entry += m_all_rbds[i];
-          this->ux().push_back(entry);
-        }
-      }
-      RBDsState(RBDs all_rbds) : RBDsState(all_rbds,Mod10View(all_rbds)) {}
-  
-    };
-  
-    struct May2AprilState : public StateImpl {
-      StateFactory RBDs_factory = []() {
-        auto  all_rbds = RBDsState::RBDs{
-           "RBD #0"
-          ,"RBD #1"
-          ,"RBD #2"
-          ,"RBD #3"
-          ,"RBD #4"
-          ,"RBD #5"
-          ,"RBD #6"
-          ,"RBD #7"
-          ,"RBD #8"
-          ,"RBD #9"
-          ,"RBD #10"
-          ,"RBD #11"
-          ,"RBD #12"
-          ,"RBD #13"
-          ,"RBD #14"
-          ,"RBD #15"
-          ,"RBD #16"
-          ,"RBD #17"
-          ,"RBD #18"
-          ,"RBD #19"
-          ,"RBD #20"
-          ,"RBD #21"
-          ,"RBD #22"
-          ,"RBD #23"
-        };        
-        return std::make_shared<RBDsState>(all_rbds);
-      };
-      May2AprilState(StateImpl::UX ux) : StateImpl{ux} {
-        this->add_option('0',{"RBD:s",RBDs_factory});
-      }
-    };
-  
-    struct VATReturnsState : public StateImpl {
-      VATReturnsState(StateImpl::UX ux) : StateImpl{ux} {}
-    };
-  
-    struct Q1State : public StateImpl {
-      StateFactory VATReturns_factory = []() {
-        auto VATReturns_ux = StateImpl::UX{
-          "VAT Returns UX goes here"
-        };
-        return std::make_shared<VATReturnsState>(VATReturns_ux);
-      };
-      Q1State(StateImpl::UX ux) : StateImpl{ux} {
-        this->add_option('0',{"VAT Returns",VATReturns_factory});
-      }
-    };
-  
-    struct ProjectState : public StateImpl {
-      StateFactory may2april_factory = []() {
-        auto may2april_ux = StateImpl::UX{
-          "May to April"
-        };
-        return std::make_shared<May2AprilState>(may2april_ux);
-      };
-  
-      StateFactory q1_factory = []() {
-        auto q1_ux = StateImpl::UX{
-          "Q1 UX goes here"
-        };
-        return std::make_shared<Q1State>(q1_ux);
-      };
-  
-      ProjectState(StateImpl::UX ux) : StateImpl{ux} {
-        this->add_option('0',{"May to April",may2april_factory});
-        this->add_option('1',{"Q1",q1_factory});
-      }
-    };
-  
-    struct WorkspaceState : public StateImpl {
-      StateFactory itfied_factory = []() {
-        auto itfied_ux = StateImpl::UX{
-          "ITfied UX"
-        };
-        return std::make_shared<ProjectState>(itfied_ux);
-      };
-  
-      StateFactory orx_x_factory = []() {
-        auto org_x_ux = StateImpl::UX{
-          "Other Organisation UX"
-        };
-        return std::make_shared<ProjectState>(org_x_ux);
-      };
-  
-      WorkspaceState(StateImpl::UX ux) : StateImpl{ux} {
-        this->add_option('0',{"ITfied AB",itfied_factory});        
-        this->add_option('1',{"Org x",orx_x_factory});        
-      }
-    }; // Workspace StateImpl
-  
-    struct FrameworkState : public StateImpl {
-      StateFactory workspace_0_factory = []() {
-        auto workspace_0_ux = StateImpl::UX{
-          "Workspace UX"
-        };
-        return std::make_shared<WorkspaceState>(workspace_0_ux);
-      };
-  
-      FrameworkState(StateImpl::UX ux) : StateImpl{ux} {
-        this->add_option('0',{"Workspace x",workspace_0_factory});        
-      }
-  
-      virtual std::pair<std::optional<State>,Cmd> update(Msg const& msg) {
-        std::optional<State> new_state{};
-        auto key_msg_ptr = std::dynamic_pointer_cast<NCursesKey>(msg);
-        if (key_msg_ptr != nullptr) {
-          auto ch = key_msg_ptr->key;
-          if (ch == '+') {
-            this->m_ux.back().push_back('+');
-            new_state = std::make_shared<FrameworkState>(*this);          
-          }
-        }
-        return {new_state,Nop};
+    return 0;
+  }
+
+  // Runs on terminal (kept by the caller across restarts)
+  int main(int argc, char *argv[], html_msg_ncurses::Renderer& terminal, std::function<void(runtime::Clock::duration)> const& on_first_frame) {
+    Runtime<Model, Msg, Cmd> app(init, view, update, update_batch, subscriptions);
+    app.set_subscriptions_key(subscriptions_key);
+    app.set_snapshot("logs/first.snapshot"); // Survives a dropped terminal
+    app.on_first_frame(on_first_frame);
+    app.set_frame_memory(); // Views are built in per-frame arenas (Msgs and RBD states are pooled)
+    app.set_max_fps(60); // Progressive loading is drawn per frame, not per chunk
+#ifdef STRATOCEPH_ALLOC_PROFILE_NEW
+    // A prompt keystroke should not need more than this (a frame over budget is logged as a warning)
+    app.set_allocation_budget(runtime::alloc::Budget{}
+      .limit(runtime::alloc::Phase::View,32)
+      .limit(runtime::alloc::Phase::Update,16));
+#endif
+    return app.run(argc, argv, terminal);
+  }
+
+  // Prints the time to the first frame on a fresh and on a reused terminal (example --bench-startup)
+  int bench_startup(int argc, char *argv[], int runs) {
+    // A terminal of its own: drawn to /dev/null, and a 'q' typed to quit each run after its first frame
+    int keys[2]{};
+    if (::pipe(keys) != 0) throw std::runtime_error(std::format("bench_startup: pipe failed, errno:{}",errno));
+    FILE* in = ::fdopen(keys[0], "r");
+    FILE* out = std::fopen("/dev/null", "w");
+    if (std::getenv("TERM") == nullptr) ::setenv("TERM", "xterm", 0);
+
+    Runtime<Model, Msg, Cmd> app(init, view, update, update_batch);
+    app.set_frame_memory();
+    std::vector<double> ms{};
+    app.on_first_frame([&ms](runtime::Clock::duration duration) {
+      ms.push_back(std::chrono::duration<double,std::milli>(duration).count());
+    });
+    auto measure = [&](auto&&... backend_args) {
+      ms.clear();
+      for (int i=0;i<runs;++i) {
+        if (::write(keys[1], "q", 1) != 1) throw std::runtime_error("bench_startup: failed to type 'q'");
+        app.run(argc, argv, backend_args...);
       }
-  
-    };
-  
-    auto framework_state_factory = []() {
-      auto framework_ux = StateImpl::UX{
-        "Framework UX"
-      };
-      return std::make_shared<FrameworkState>(framework_ux);
+      std::ranges::sort(ms);
+      return std::format("min:{:>7.3f} ms median:{:>7.3f} ms max:{:>7.3f} ms",ms.front(),ms[ms.size()/2],ms.back());
     };
-  
-    struct Model {
-      std::string top_content;
-      std::string main_content;
-      std::string user_input;
-      /*
-      The stack contains the 'path of states' the user has navigated to.
-      */
-      std::stack<State> stack{};
-    };
-  
-    // ----------------------------------
-    // Begin: Model
-    // ----------------------------------
-  
-    bool is_quit_msg(Msg const& msg) {
-      // std::cout << "\nis_quit_msg sais Hello" << std::flush;
-      return msg == QUIT_MSG;
+    auto const cold = [&] {
+      auto const saved = std::exchange(runs,1);
+      auto result = measure(out, in);
+      runs = saved;
+      return result;
+    }();
+    auto const fresh = measure(out, in); // newterm per run
+    std::string reused{};
+    {
+      html_msg_ncurses::Renderer terminal{out, in};
+      reused = measure(terminal);
     }
-  
-    // ----------------------------------
-    // Begin: init,update,view
-    // ----------------------------------
-  
-    std::tuple<Model,runtime::IsQuit<Msg>,Cmd> init() {
-      // std::cout << "\ninit sais Hello :)" << std::flush;
-      Model model = { "Welcome to the top section"
-                     ,"This is the main content area"
-                     ,""};
-  
-      model.stack.push(framework_state_factory());
-      return {model,is_quit_msg,Nop};
+    std::cout << std::format("time to first frame, runs:{}\n  cold (first in process) {}\n  fresh terminal          {}\n  reused terminal         {}\n",runs,cold,fresh,reused);
+    std::fclose(out);
+    std::fclose(in);
+    ::close(keys[1]);
+    return 0;
+  }
+
+  // A random operator key: mostly option keys, and back, prompt typing, jumps ('/' keys Enter) and paging
+  int random_key(std::mt19937& random) {
+    switch (std::uniform_int_distribution<int>{0,19}(random)) {
+      case 0: case 1: return '-';
+      case 2: return '\n';
+      case 3: return KEY_BACKSPACE;
+      case 4: return '/';
+      case 5: return 'x';
+      case 6: return KEY_NPAGE;
+      case 7: return KEY_PPAGE;
+      default: return RangePartition::KEYS[std::uniform_int_distribution<std::size_t>{0,11}(random)];
     }
-  
-    std::pair<Model,Cmd> update(Model model, Msg msg) {
-  
-      Cmd cmd = Nop;
-      std::optional<State> new_state{};
-      if (model.stack.size()>0) {
-        auto pp = model.stack.top()->update(msg);
-        new_state = pp.first;
-        cmd = pp.second;
-      }
-      if (new_state) {
-        // Let 'StateImpl' update itself
-        model.stack.top() = *new_state; // mutate
-      }
-      else {
-        // Process StateImpl transition or user input
-        if (auto key_msg_ptr = std::dynamic_pointer_cast<NCursesKey>(msg);key_msg_ptr != nullptr) {
-          auto ch = key_msg_ptr->key; 
-          if (ch == KEY_BACKSPACE || ch == 127) { // Handle backspace
-            if (!model.user_input.empty()) {
-              model.user_input.pop_back();
-            }
-          } 
-          else if (ch == '\n') {
-            // User pressed Enter: process command (optional)
-            model.user_input.clear(); // Reset input after submission
-          } 
-          else {
-            if (model.user_input.empty() and ch == 'q' or model.stack.size()==0) {
-              // std::cout << "\nTime to QUIT!" << std::flush;
-              cmd = DO_QUIT;
-            }
-            else if (model.user_input.empty() and model.stack.size() > 0) {
-              if (ch == '-') {
-                // (1) Transition back to old StateImpl
-                model.stack.pop();
-              } 
-              else if (model.stack.top()->options().contains(ch)) {
-                // (2) Transition to new StateImpl
-                cmd = [ch,parent = model.stack.top()]() -> Msg {
-                  State new_state = parent->options().at(ch).second();
-                  auto msg = std::make_shared<PushStateMsg>(parent,new_state);
-                  return msg;
-                };
-              }
-              else {
-                model.user_input += ch; // Append typed character
-              }
-            }
-            else {
-                model.user_input += ch; // Append typed character
-            }
-          }
-        }    
-        else if (auto pimpl = std::dynamic_pointer_cast<PushStateMsg>(msg);pimpl != nullptr) {
-          if (model.stack.top() == pimpl->m_parent) {
-            // The transition matches
-            model.stack.push(pimpl->m_state);
-          }
-          else {
-            model.user_input.push_back('?');
-          }
-        }    
-      }
-      // Update UX
-      if (model.stack.size() > 0) {
-        // StateImpl UX (top window)
-        model.top_content.clear();
-        for (std::size_t i=0;i<model.stack.top()->ux().size();++i) {
-          if (i>0) model.top_content.push_back('\n');
-          model.top_content += model.stack.top()->ux()[i];
-        }
-        // StateImpl transition UX (Midle window)
-        model.main_content.clear();
-        for (auto const &[ch, option] : model.stack.top()->options()) {
-          std::string entry{};
-          entry.push_back(ch);
-          entry.append(" - ");
-          entry.append(option.first);
-          entry.push_back('\n');
-          model.main_content.append(entry);
-        }
-      }
-  
-      return {model,cmd}; // Return updated model
+  }
+
+  // rows RBDs, made once (shared by the sessions of a soak run)
+  RBDsState::RBDStore large_store(std::size_t rows) {
+    static auto const result = [rows] {
+      RBDsState::RBDs rbds(rows);
+      for (std::size_t i=0;i<rows;++i) rbds[i] = "RBD #" + std::to_string(i);
+      return std::make_shared<RBDsState::RBDs const>(std::move(rbds));
+    }();
+    return result;
+  }
+
+  // Appends a jump ('/' keys Enter) to a random sub-range of a store of rows (at most 6 keys deep)
+  void random_jump(std::mt19937& random, std::size_t rows, std::vector<int>& keys) {
+    keys.push_back('/');
+    auto const depth = std::uniform_int_distribution<int>{1,6}(random);
+    for (int i=0;i<depth and rows > 1;++i) {
+      auto const range = RangePartition{RangePartition::Range{0,rows}};
+      auto const sub = std::uniform_int_distribution<std::size_t>{0,range.count()-1}(random);
+      keys.push_back(RangePartition::key(sub));
+      rows = range.subrange(sub).second - range.subrange(sub).first;
     }
-  
-    Html_Msg<Msg> view(const Model &model) {
-      // std::cout << "\nview sais Hello :)" << std::flush;
-  
-      // Create a new pugi document
-      Html_Msg<Msg> ui{};
-      auto& doc = ui.doc;
-  
-      // Note: HTML doc may be tested for validity at:
-      // https://www.w3schools.com/html/tryit.asp?filename=tryhtml_intro
-  
-      // Create the root HTML element
-      pugi::xml_node html = doc.append_child("html");
-  
-      // Create the body
-      pugi::xml_node body = html.append_child("body");
-  
-      // Create the top section with class "content"
-      pugi::xml_node top = body.append_child("div");
-      top.append_attribute("class") = "content";
-      top.text().set(model.top_content.c_str());
-  
-      // Create the main section with class "content"
-      pugi::xml_node main = body.append_child("div");
-      main.append_attribute("class") = "content";
-      main.text().set(model.main_content.c_str());
-  
-      // Create the user prompt section with class "user-prompt"
-      pugi::xml_node prompt = body.append_child("div");
-      prompt.append_attribute("class") = "user-prompt";
-      // Add a label element for the prompt text
-      pugi::xml_node label = prompt.append_child("label");
-      label.text().set((">" + model.user_input).c_str());
-  
-      // Make prompt 'html-correct' (even though render does not care for now)
-      pugi::xml_node input = prompt.append_child("input");
-      input.append_attribute("type") = "text";
-      input.append_attribute("id") = "command";
-      input.append_attribute("name") = "command";
-  
-      ui.event_handlers["OnKey"] = onKey;
-      return ui;
+    keys.push_back('\n');
+  }
+
+  // Drives the first app on renderer with random_key for iterations keys, restarting it whenever it quits
+  // (example --soak [iterations] [terminal] [large] [--seed n]). Fails when RSS, latency or queues grow beyond the thresholds.
+  // The keys are random from seed (printed, to repeat a failed run with --seed).
+  // With store_rows ('large' is 10^6), each session starts in the RBD:s of a store of that many rows,
+  // and a tenth of the keys are random jumps into it (a fresh sub-range StateImpl and its loading).
+  template <runtime::Renderer R>
+  int soak(int argc, char *argv[], R& renderer, std::size_t iterations, std::uint32_t seed, std::size_t store_rows = 0) {
+    using Backend = runtime::soak::Scripted<R>;
+    auto init_soak = [store_rows]() -> std::tuple<Model,runtime::IsQuit<Msg>,Cmd> {
+      auto [model, is_quit, cmd] = init();
+      if (store_rows == 0) return {model,is_quit,cmd};
+      model.stack = {}; // '-' from the store quits (and the next session starts over)
+      model.stack.push(runtime::memory::make_pooled<RBDsState>(large_store(store_rows)));
+      return {model,is_quit,enter(model)};
+    };
+    Runtime<Model, Msg, Cmd, Backend> app(init_soak, view, update, update_batch, subscriptions);
+    app.set_subscriptions_key(subscriptions_key);
+    app.set_frame_memory();
+    runtime::soak::Thresholds thresholds{};
+    if (store_rows > 0) {
+      // Each session loads its store rows progressively (tens of MiB), so RSS swings with how far they got,
+      // and a key may wait for a loading chunk (64Ki rows, tens of ms)
+      if (thresholds.rss_growth > 0) thresholds.rss_growth = 2.0;
+      thresholds.p99_floor_ms = 50.0;
+      thresholds.warmup_windows = 10;
     }
-  
-    // ----------------------------------
-    // End: init,update,view
-    // ----------------------------------
-} // namespace first
+    runtime::soak::Monitor monitor{thresholds};
+    monitor.on_window([](runtime::soak::Window const& window) {
+      std::cout << runtime::soak::to_string(window) << std::endl;
+    });
+    app.on_pump([&monitor](runtime::QueueDepths const& depths) {monitor.queues(depths);});
+    std::cout << std::format("soak seed:{}",seed) << std::endl;
+    std::mt19937 random{seed};
+    Backend backend{renderer, [&](std::vector<int>& keys) {
+      if (store_rows > 0 and std::uniform_int_distribution<int>{0,9}(random) == 0) random_jump(random, store_rows, keys);
+      else keys.push_back(random_key(random));
+      return monitor.iteration() and monitor.iterations() < iterations;
+    }, monitor};
+    auto const level = spdlog::get_level();
+    spdlog::set_level(spdlog::level::warn); // The runtime logs every loop at info
+    std::size_t sessions{};
+    while (backend.open()) {
+      app.run(argc, argv, backend);
+      ++sessions;
+    }
+    spdlog::set_level(level);
+    if (not monitor.failure().empty()) {
+      std::cout << std::format("soak FAILED after {} iterations ({} sessions, seed:{}), {}\n",monitor.iterations(),sessions,seed,monitor.failure());
+      return 1;
+    }
+    std::cout << std::format("soak passed, {} iterations ({} sessions)\n",monitor.iterations(),sessions);
+    return 0;
+  }
 
-namespace first {
+  // Applies key to model, and then the Msg of its Cmd (e.g., the PushStateMsg of an option key).
+  // Loading Tasks are not run.
+  void type(Model& model, int key) {
+    auto [typed, cmd] = update(std::move(model), Msg{std::make_shared<NCursesKey>(key)});
+    model = std::move(typed);
+    if (auto msg = cmd()) model = update(std::move(model), *msg).first;
+  }
 
-int main(int argc, char *argv[]) {
-    Runtime<Model, Msg, Cmd> app(init, view, update);
-    return app.run(argc, argv);
+  // Checks navigation on the update functions, without a terminal (example --self-test, run by ctest)
+  int self_test() {
+    int failed{};
+    auto check = [&failed](bool ok, std::string_view what) {
+      if (not ok) ++failed;
+      std::cout << std::format("{} {}\n",ok ? "PASS" : "FAIL",what);
+    };
+    auto same_path = [](Model const& model) {
+      runtime::SnapshotWriter out{};
+      save(model,out);
+      auto restored = std::get<0>(init());
+      runtime::SnapshotReader in{out.bytes()};
+      return restore(restored,in) and restored.keys == model.keys and restored.stack.size() == model.stack.size();
+    };
+    auto model = std::get<0>(init());
+    for (auto ch : std::string_view{"0000"}) type(model,ch); // To the RBD:s of May to April
+    check(model.stack.size() == 5 and same_path(model),"restores the option keys path");
+    for (auto ch : std::string_view{"/12\n"}) type(model,ch);
+    check(model.stack.size() == 6 and model.keys.back() == "12" and same_path(model),"a jump restores as one StateImpl");
+    type(model,'-');
+    check(model.stack.size() == 5 and model.keys.size() == 4 and same_path(model),"'-' leaves a jump with all its keys");
+    runtime::SnapshotWriter corrupt{};
+    corrupt.varint(std::uint64_t{1} << 60);
+    runtime::SnapshotReader corrupt_in{corrupt.bytes()};
+    auto corrupt_model = std::get<0>(init());
+    check(not restore(corrupt_model,corrupt_in),"a corrupt key count is not restored");
+    check(Workspace::make() == Workspace::make() and not std::weak_ptr<StateImpl>{Workspace::make()}.expired(),"a Menu is one StateImpl with valid weak_ptrs");
+    return (failed == 0) ? 0 : 1;
+  }
+
+#ifdef __linux__
+  // Many operators in one process, e.g. 'socat UNIX-CONNECT:<socket_path> STDIO,raw,echo=0'
+  int serve(std::filesystem::path const& socket_path) {
+    Runtime<Model, Msg, Cmd> app(init, view, update, update_batch, subscriptions);
+    app.set_subscriptions_key(subscriptions_key);
+    app.set_frame_memory(); // Many sessions in one process, keep them off the global heap
+    app.set_max_fps(30);
+    return app.serve(socket_path);
   }
+#endif
 } // namespace first
 
 
@@ -529,7 +264,7 @@ namespace zeroth {
       return {};
   }
 
-  bool is_quit(Msg const& msg) {
+  bool is_quit(Msg const&) {
       return false;
   }
 
@@ -537,47 +272,140 @@ namespace zeroth {
       return {{},is_quit,NoOp};
   }
 
-  std::optional<Msg> on_key(tea::Event const& event) {
+  std::optional<Msg> on_key(tea::Event const&) {
       return {};
   }
 
-  Html view(Model const& model) {
+  Html view(Model const&) {
       Html result{};
       result.event_handlers["OnKey"] = on_key;
       return result;
   }
 
-  std::pair<Model, Cmd> update(Model const &model, Msg const &msg) {
+  std::pair<Model, Cmd> update(Model const &model, Msg const &) {
     return {Model{model}, NoOp};
   }
 
-  int main(int argc, char *argv[]) {
+  // Runs on window, opened by the first run and kept by the caller for the next
+  int main(int argc, char *argv[], std::optional<html_msg_imgui_glfw::Backend>& window) {
     tea::App<Model, Msg> app(init, view, update);
     // std::cout << "\nFirst to call run :)" << std::flush;
-    return app.run(argc, argv);
+    try {
+      if (not window) window.emplace();
+    }
+    catch (std::exception const& e) {
+      spdlog::error("zeroth::main failed to open a window, {}",e.what());
+      return -1;
+    }
+    auto result = app.run(argc, argv, *window);
+    window->suspend();
+    return result;
   }
   
 } // namespace zeroth
 
-int main(int argc, char *argv[]) {
+// The rotating log file is opened after the first frame, so startup does not wait for the file system.
+// Messages before that are kept in memory (the last EARLY_MESSAGES) and written first.
+class DeferredLog {
+public:
+  static constexpr std::size_t EARLY_MESSAGES{1024};
 
+  DeferredLog()
+    :  m_early{std::make_shared<spdlog::sinks::ringbuffer_sink_mt>(EARLY_MESSAGES)}
+      ,m_sinks{std::make_shared<spdlog::sinks::dist_sink_mt>(std::vector<spdlog::sink_ptr>{m_early})} {
     // See https://github.com/gabime/spdlog
-    auto logger = spdlog::rotating_logger_mt("rotating_logger", "logs/rotating_log.txt", 5 * 1024 * 1024, 3);
-    spdlog::set_default_logger(logger);
+    spdlog::set_default_logger(std::make_shared<spdlog::logger>("rotating_logger", m_sinks));
+  }
+  ~DeferredLog() {
+    try {
+      open(); // Keep what was logged, even without a frame
+    }
+    catch (std::exception const& e) {
+      std::cerr << std::format("DeferredLog: failed to open the log file, {}\n",e.what()); // Not thrown from a destructor
+    }
+  }
+  DeferredLog(DeferredLog const&) = delete;
+  DeferredLog& operator=(DeferredLog const&) = delete;
+
+  void open() {
+    if (m_opened) return;
+    m_opened = true;
+    auto file = std::make_shared<spdlog::sinks::rotating_file_sink_mt>("logs/rotating_log.txt", 5 * 1024 * 1024, 3);
+    for (auto const& msg : m_early->last_raw()) file->log(msg);
+    m_sinks->set_sinks({file});
+  }
+
+private:
+  std::shared_ptr<spdlog::sinks::ringbuffer_sink_mt> m_early;
+  std::shared_ptr<spdlog::sinks::dist_sink_mt> m_sinks;
+  bool m_opened{false};
+};
+
+int main(int argc, char *argv[]) {
+
+    DeferredLog log{};
 
     if (true) {
-        // conan template generated code
+        // conan template generated code (the conan test_package output)
         stratoceph();
         std::vector<std::string> vec;
         vec.push_back("test_package");
         stratoceph_print_vector(vec);
     }
+    if (argc > 1 and std::string{argv[1]} == "--version") {
+      return 0; // Only the above
+    }
+
+    if (argc > 1 and std::string{argv[1]} == "--bench-rows") {
+      return first::bench_rows();
+    }
+    if (argc > 1 and std::string{argv[1]} == "--soak") {
+      auto const iterations = (argc > 2) ? std::stoull(argv[2]) : 1'000'000ull;
+      auto const option = [argc,argv](std::string_view name) {return std::find(argv + std::min(argc,3), argv + argc, name) != argv + argc;};
+      auto const store_rows = option("large") ? std::size_t{1'000'000} : std::size_t{0};
+      auto const seed_arg = std::find(argv + std::min(argc,3), argv + argc, std::string_view{"--seed"});
+      auto const seed = (seed_arg + 1 < argv + argc) ? static_cast<std::uint32_t>(std::stoul(seed_arg[1])) : std::random_device{}();
+      if (option("terminal")) {
+        // Soaks the ncurses renderer too (its windows), drawn to /dev/null
+        if (std::getenv("TERM") == nullptr) ::setenv("TERM", "xterm", 0);
+        FILE* out = std::fopen("/dev/null", "w");
+        FILE* in = std::fopen("/dev/null", "r");
+        int result{};
+        {
+          html_msg_ncurses::Renderer terminal{out, in};
+          result = first::soak(argc, argv, terminal, iterations, seed, store_rows);
+        }
+        std::fclose(in);
+        std::fclose(out);
+        return result;
+      }
+      runtime::Headless headless{};
+      return first::soak(argc, argv, headless, iterations, seed, store_rows);
+    }
+    if (argc > 1 and std::string{argv[1]} == "--self-test") {
+      return first::self_test();
+    }
+    if (argc > 1 and std::string{argv[1]} == "--bench-startup") {
+      return first::bench_startup(argc, argv, (argc > 2) ? std::stoi(argv[2]) : 20);
+    }
+#ifdef __linux__
+    if (argc > 2 and std::string{argv[1]} == "--serve") {
+      log.open(); // No terminal frame to wait for
+      return first::serve(argv[2]);
+    }
+#endif
 
     // Hack - code to refactor into client an stratoceph lib code
+    // The terminal and window are set up once, and kept across restarts
+    html_msg_ncurses::Renderer terminal{};
+    std::optional<html_msg_imgui_glfw::Backend> window{};
+    auto on_first_frame = [&log](runtime::Clock::duration) {log.open();};
     int result{};
     while (true) {
-      if (result = first::main(argc,argv);result == 0) break;
-      if (result = zeroth::main(argc,argv);result == 0) break;
+      result = first::main(argc,argv,terminal,on_first_frame);
+      terminal.suspend();
+      if (result == 0) break;
+      if (result = zeroth::main(argc,argv,window);result == 0) break;
     }
     return result;
 
@@ -0,0 +1,975 @@
+#pragma once
+// The first app: a navigable tree of StateImpls (model, update, view, subscriptions and snapshots).
+// Run by example, and driven by runtime_test on the headless backend.
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stack>
+#include <stdexcept>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <ncurses.h> // Key codes
+#include "stratoceph/runtime/runtime.hpp"
+
+namespace first {
+
+    // Splits a size_t range into at most fanout sub-ranges, addressed by option keys
+    //   PowerOfFanout - sub-ranges of the largest power of fanout less than the size (fanout 10 = mod10 view)
+    //   Balanced      - fanout sub-ranges of (almost) equal size
+    struct RangePartition {
+      using Range = std::pair<size_t,size_t>;
+      enum class Strategy {PowerOfFanout,Balanced};
+      // Option keys in sub-range order. Not 'q' (quit) nor '-' (back).
+      static constexpr std::string_view KEYS{"0123456789abcdefghijklmnoprstuvwxyz"};
+
+      Range m_range;
+      size_t m_fanout;
+      Strategy m_strategy;
+  
+      RangePartition(Range range,size_t fanout = 10,Strategy strategy = Strategy::PowerOfFanout)
+        :  m_range{range}
+          ,m_fanout{std::clamp<size_t>(fanout,2,KEYS.size())}
+          ,m_strategy{strategy} {}
+  
+      template <class T>
+      RangePartition(T const& container,size_t fanout = 10,Strategy strategy = Strategy::PowerOfFanout)
+        : RangePartition(Range(0,container.size()),fanout,strategy) {}
+
+      size_t size() const {return m_range.second-m_range.first;}
+
+      // The number of sub-ranges
+      size_t count() const {
+        if (size() == 0) return 0;
+        if (m_strategy == Strategy::Balanced) return std::min(m_fanout,size());
+        return (size()+step()-1)/step();
+      }
+
+      // Sub-range i as [begin,end[. O(1) (O(log size) for PowerOfFanout), integer only.
+      Range subrange(size_t i) const {
+        if (m_strategy == Strategy::Balanced) {
+          auto const n = count();
+          auto const base = size()/n;
+          auto const rest = size()%n;
+          auto const begin = m_range.first + i*base + std::min(i,rest);
+          return {begin,begin + base + (i < rest ? 1 : 0)};
+        }
+        auto const begin = m_range.first + i*step();
+        return {begin,std::min(begin+step(),m_range.second)};
+      }
+
+      // The partition of the sub-range at the end of the keys path (e.g., "34" = sub-range 4 of sub-range 3).
+      // Computed without building the states in between. Nullopt for an invalid path.
+      std::optional<RangePartition> descend(std::string_view keys) const {
+        RangePartition result{*this};
+        for (auto key : keys) {
+          auto const i = KEYS.find(key);
+          if (i == std::string_view::npos or i >= result.count()) return std::nullopt;
+          result.m_range = result.subrange(i);
+        }
+        return result;
+      }
+  
+      // return vector of [begin,end[
+      std::vector<Range> subranges() const {
+        std::vector<Range> result{};
+        for (size_t i=0;i<count();++i) result.push_back(subrange(i));
+        return result;
+      }
+
+      static char key(size_t i) {return KEYS[i];}
+
+    private:
+      // The largest power of fanout less than size (1 for size <= fanout)
+      size_t step() const {
+        size_t result{1};
+        while (result < (size() + m_fanout - 1) / m_fanout) result *= m_fanout;
+        return result;
+      }
+    };
+  
+    // Rows a build_rows thread takes at least (fewer are not worth a thread)
+    inline constexpr size_t MIN_ROWS_PER_THREAD{16*1024};
+
+    // Formats the rows "<index>. <name>" for names [begin,end[.
+    // Large ranges are split in chunks built in parallel (one per thread, at most max_threads).
+    inline std::vector<std::string> build_rows(std::vector<std::string> const& names,size_t begin,size_t end
+                                              ,size_t max_threads = std::thread::hardware_concurrency()) {
+      std::vector<std::string> result(end-begin);
+      auto build = [&names,&result,begin](size_t first,size_t last) {
+        char digits[24];
+        for (size_t i=first;i<last;++i) {
+          auto const digits_end = std::to_chars(digits,digits+sizeof(digits),i).ptr;
+          auto& row = result[i-begin];
+          row.reserve((digits_end-digits) + 2 + names[i].size());
+          row.append(digits,digits_end).append(". ").append(names[i]);
+        }
+      };
+      auto const threads = std::min<size_t>(std::max<size_t>(1,max_threads),(end-begin)/MIN_ROWS_PER_THREAD);
+      if (threads <= 1) {
+        build(begin,end);
+        return result;
+      }
+      auto const chunk = (end-begin+threads-1)/threads;
+      {
+        std::vector<std::jthread> workers{};
+        for (size_t first=begin+chunk;first<end;first += chunk) {
+          workers.emplace_back(build,first,std::min(first+chunk,end));
+        }
+        build(begin,std::min(begin+chunk,end)); // This thread takes the first chunk
+      } // Joins the workers
+      return result;
+    }
+  
+    // ----------------------------------
+    // Begin: Forward State
+    // ----------------------------------
+  
+    struct StateImpl; // Forward
+    using State = std::shared_ptr<StateImpl>;
+  
+    // ----------------------------------
+    // End: Forward State
+    // ----------------------------------
+  
+    // ----------------------------------
+    // Begin: Message
+    // ----------------------------------
+  
+    struct MsgImpl {
+      virtual ~MsgImpl() = default;
+    };
+  
+    using Msg = std::shared_ptr<MsgImpl>;
+  
+    struct NCursesKey : public MsgImpl {
+      int key;
+      NCursesKey(int key) : MsgImpl{}, key{key} {}
+    };
+  
+    struct Quit : public MsgImpl {};
+
+    // Scrolls the UX window by lines (the top section shows page lines)
+    struct ScrollMsg : public MsgImpl {
+      int lines;
+      int page;
+      ScrollMsg(int lines,int page) : MsgImpl{}, lines{lines}, page{page} {}
+    };
+  
+    struct PushStateMsg : public MsgImpl {
+      State m_parent{};
+      char m_key{}; // The option of m_parent that made m_state
+      State m_state{};
+      PushStateMsg(State const& parent,char key,State const& state)
+        :  m_parent{parent}
+          ,m_key{key}
+          ,m_state{state} {}
+    };
+  
+    // Rows for the UX of m_state (progressive loading)
+    struct AppendUXMsg : public MsgImpl {
+      State m_state{};
+      std::vector<std::string> m_rows{};
+      AppendUXMsg(State const& state,std::vector<std::string>&& rows)
+        :  m_state{state}
+          ,m_rows{std::move(rows)} {}
+    };
+  
+    inline Msg const QUIT_MSG{std::make_shared<Quit>()};
+  
+    // ----------------------------------
+    // END: Message
+    // ----------------------------------
+  
+    // ----------------------------------
+    // Begin: Subscription
+    // ----------------------------------
+  
+    inline std::optional<Msg> onKey(Event event) {
+      if (event.contains("Key")) {
+        return Msg{runtime::memory::make_pooled<NCursesKey>(std::stoi(event["Key"]))};
+      }
+      return std::nullopt;
+    }
+
+    inline std::optional<Msg> onScroll(Event event) {
+      return Msg{runtime::memory::make_pooled<ScrollMsg>(std::stoi(event["Lines"]),std::stoi(event["Page"]))};
+    }
+  
+    // ----------------------------------
+    // End: Subscription
+    // ----------------------------------
+  
+    // ----------------------------------
+    // Begin: Command
+    // ----------------------------------
+  
+    using Cmd = runtime::Cmd<Msg>;
+  
+    inline Cmd const Nop{}; // Empty - never queued by the runtime
+  
+    inline std::optional<Msg> DO_QUIT() {
+      return QUIT_MSG;
+    };
+  
+    // ----------------------------------
+    // End: Command
+    // ----------------------------------
+  
+    using StateFactory = std::function<State()>;
+  
+    // ----------------------------------
+    // Begin: Options
+    // ----------------------------------
+  
+    struct Option {
+      char ch;
+      StateFactory factory;
+      std::size_t caption_first{}; // The caption in the option text (see Options::caption)
+      std::size_t caption_size{};
+      bool prebuilt{}; // factory returns a StateImpl built once (a static Menu), pushed without a transition Cmd
+    };
+  
+    // Flat option table. Options sorted by key, looked up by one index over all 256 key values.
+    // Captions are kept only in the pre-rendered option text of their table (no pool, copies stay valid).
+    class Options {
+    public:
+      void add(char ch,std::string_view caption,StateFactory factory,bool prebuilt = false) {
+        auto const index = static_cast<unsigned char>(ch);
+        auto at = std::size_t{};
+        if (m_index[index] > 0) {
+          at = m_index[index]-1;
+        }
+        else {
+          auto iter = std::find_if(m_options.begin(),m_options.end(),[ch](Option const& option){return option.ch > ch;});
+          at = static_cast<std::size_t>(iter - m_options.begin());
+          m_options.insert(iter,Option{ch,{}});
+          for (std::size_t i=0;i<m_options.size();++i) m_index[static_cast<unsigned char>(m_options[i].ch)] = i+1;
+        }
+        m_options[at].factory = std::move(factory);
+        m_options[at].prebuilt = prebuilt;
+        // Pre-render the option text (what the menu shows), with the captions taken from the previous one
+        std::string text{};
+        for (std::size_t i=0;i<m_options.size();++i) {
+          auto& option = m_options[i];
+          auto const option_caption = (i == at) ? caption : this->caption(option);
+          text.push_back(option.ch);
+          text.append(" - ");
+          option.caption_first = text.size();
+          option.caption_size = option_caption.size();
+          text.append(option_caption);
+          text.push_back('\n');
+        }
+        m_text = std::move(text);
+      }
+      std::string_view caption(Option const& option) const {
+        return std::string_view{m_text}.substr(option.caption_first,option.caption_size);
+      }
+      // ch is a key code (may be outside char range, e.g. KEY_BACKSPACE)
+      bool contains(int ch) const {return ch >= 0 and ch < 256 and m_index[ch] > 0;}
+      Option const& at(int ch) const {
+        if (not contains(ch)) throw std::out_of_range(std::format("Options::at, no option for key:{}",ch));
+        return m_options[m_index[ch]-1];
+      }
+      auto begin() const {return m_options.begin();}
+      auto end() const {return m_options.end();}
+      std::string const& text() const {return m_text;}
+    private:
+      std::vector<Option> m_options{};
+      std::array<std::uint16_t,256> m_index{}; // 0 = no option, else index + 1 (up to 256)
+      std::string m_text{};
+    };
+  
+    // ----------------------------------
+    // End: Options
+    // ----------------------------------
+  
+    // ----------------------------------
+    // Begin: Model
+    // ----------------------------------
+  
+    struct StateImpl {
+    private:
+    public:
+      using UX = std::vector<std::string>;
+      UX m_ux;
+      Options m_options;
+      bool m_shared{}; // A static Menu, shared by all sessions and never changed (see Menu)
+      StateImpl(UX const& ux) : m_ux{ux},m_options{} {}
+      void add_option(char ch,std::pair<std::string_view,StateFactory> option,bool prebuilt = false) {
+        m_options.add(ch,option.first,std::move(option.second),prebuilt);
+      }
+      UX const& ux() const {return m_ux;}
+      UX& ux() {return m_ux;}
+      Options const& options() const {return m_options;}
+      virtual std::pair<std::optional<State>,Cmd> update(Msg const&) {
+        return {std::nullopt,Nop}; // Default - no StateImpl mutation
+      }
+      // Cmd to run each time it becomes the top StateImpl (e.g., progressive loading).
+      // token is stopped when it is no longer the top, so the Cmd must resume where it stopped.
+      virtual Cmd on_enter(State const& /*self*/,std::stop_token /*token*/) {
+        return Nop;
+      }
+      // The StateImpl a command typed at the prompt jumps to, and the option keys path it stands for
+      struct Jump {
+        std::string keys;
+        State state;
+      };
+      virtual std::optional<Jump> jump(std::string_view /*command*/) {
+        return std::nullopt; // Default - no jumps
+      }
+    };
+     
+    // ----------------------------------
+    // Begin: Static state tree
+    // ----------------------------------
+
+    // Static parts of the StateImpl tree are declared as types, e.g.,
+    //   using Q1 = Menu<"Q1 UX", Item<'0',"VAT Returns",Dynamic<VATReturnsState,"VAT Returns UX">>>;
+    // A Menu is one static StateImpl (option table built once). Its options make their targets by a direct
+    // call to Target::make (a Menu or a Dynamic leaf), and a Menu target is pushed at once: no transition Cmd,
+    // no PushStateMsg and no StateImpl built. Its panel texts alias the StateImpl, so entering and leaving a Menu
+    // does not allocate (see first_menu_without_allocation in runtime_test.cpp).
+
+    template <std::size_t N>
+    struct Text {
+      char chars[N]{};
+      constexpr Text(char const (&text)[N]) {std::copy_n(text,N,chars);}
+      constexpr std::string_view view() const {return {chars,N-1};}
+    };
+
+    template <char CH,Text CAPTION,typename Target>
+    struct Item {
+      static constexpr char ch{CH};
+      static constexpr std::string_view caption{CAPTION.view()};
+      static constexpr bool prebuilt{Target::prebuilt};
+      static State make() {return Target::make();}
+    };
+
+    // A StateImpl made on demand (e.g., with dynamic data or update)
+    template <typename S,Text UX>
+    struct Dynamic {
+      static constexpr bool prebuilt{false};
+      static State make() {return std::make_shared<S>(StateImpl::UX{std::string{UX.view()}});}
+    };
+
+    template <Text UX,typename... Items>
+    struct Menu {
+      static constexpr std::array<char,sizeof...(Items)> KEYS{Items::ch...};
+      static constexpr bool valid_keys() {
+        for (std::size_t i=0;i<KEYS.size();++i) {
+          if (KEYS[i] == 'q' or KEYS[i] == '-') return false; // Quit and back
+          for (std::size_t j=i+1;j<KEYS.size();++j) if (KEYS[i] == KEYS[j]) return false;
+        }
+        return true;
+      }
+      static_assert(valid_keys(),"Menu: option keys must be unique and not 'q' or '-'");
+      static constexpr bool prebuilt{true};
+
+      // One StateImpl per Menu type, shared by all sessions (see serve). So it is never changed once built:
+      // a Menu has no update, no on_enter and no UX rows appended (per-session state belongs in the Model).
+      // Owned by a shared_ptr, so weak_ptrs to it stay valid.
+      static State make() {
+        static State const state = [] {
+          auto result = std::make_shared<StateImpl>(StateImpl::UX{std::string{UX.view()}});
+          (result->add_option(Items::ch,{Items::caption,&Items::make},Items::prebuilt),...);
+          result->m_shared = true;
+          return result;
+        }();
+        return state; // A reference count (nothing to allocate or free)
+      }
+    };
+
+    // ----------------------------------
+    // End: Static state tree
+    // ----------------------------------
+
+    struct RBDState : public StateImpl {
+      StateFactory SIE_factory = []() {
+        auto SIE_ux = StateImpl::UX{
+          "RBD to SIE UX goes here"
+        };
+        return std::make_shared<StateImpl>(SIE_ux);
+      };
+      using RBD = std::string;
+      RBD m_rbd;
+      RBDState(RBD rbd) : StateImpl({}) ,m_rbd{rbd} {
+        ux().clear();
+        ux().push_back(rbd);
+        this->add_option('0',{"RBD -> SIE",SIE_factory});
+      }
+    };
+  
+    struct RBDsState : public StateImpl {
+  
+      using RBDs = std::vector<std::string>;
+      using RBDStore = std::shared_ptr<RBDs const>; // Immutable, shared by states (and server sessions)
+      RBDsState::RBDStore m_all_rbds;
+      RangePartition m_partition;
+  
+      struct RBDs_subrange_factory {
+        // RBD subrange StateImpl factory
+        RBDsState::RBDStore m_all_rbds{};
+        RangePartition m_partition;
+  
+        auto operator()() {return runtime::memory::make_pooled<RBDsState>(m_all_rbds,m_partition);}
+  
+        RBDs_subrange_factory(RBDsState::RBDStore all_rbds, RangePartition partition)
+          :  m_all_rbds{all_rbds}
+            ,m_partition{partition} {} 
+      };
+  
+      RBDsState(RBDStore all_rbds,RangePartition partition)
+        :  StateImpl({})
+          ,m_all_rbds{all_rbds}
+          ,m_partition{partition} {
+  
+        for (size_t i=0;i<m_partition.count();++i) {
+          auto const subrange = m_partition.subrange(i);
+          auto const& [begin,end] = subrange;
+          auto caption = std::to_string(begin);
+          if (end-begin==1) {
+            // Single RBD in range option
+            this->add_option(RangePartition::key(i),{caption,[rbd=(*m_all_rbds)[begin]](){
+              // Single RBT factory
+              auto RBD_ux = StateImpl::UX{
+                "RBD UX goes here"
+              };
+              return runtime::memory::make_pooled<RBDState>(rbd);
+            }});
+          }
+          else {
+            caption += " .. ";
+            caption += std::to_string(end-1);
+            this->add_option(RangePartition::key(i),{caption,RBDs_subrange_factory(m_all_rbds,RangePartition{subrange,m_partition.m_fanout,m_partition.m_strategy})});
+          }
+        }
+  
+      }
+      RBDsState(RBDStore all_rbds) : RBDsState(all_rbds,RangePartition(*all_rbds)) {}
+
+      // "/<keys>" jumps straight to the sub-range at the end of the keys path (one StateImpl build)
+      virtual std::optional<Jump> jump(std::string_view command) {
+        if (not command.starts_with('/')) return std::nullopt;
+        auto const keys = command.substr(1);
+        auto const target = m_partition.descend(keys);
+        if (not target or keys.empty()) return std::nullopt;
+        if (target->size() == 1) return Jump{std::string{keys},runtime::memory::make_pooled<RBDState>((*m_all_rbds)[target->m_range.first])};
+        return Jump{std::string{keys},runtime::memory::make_pooled<RBDsState>(m_all_rbds,*target)};
+      }
+
+      std::size_t m_loaded{}; // UX rows built (the loading resumes from here)
+
+      // View UX rows are streamed in chunks, so the UI stays responsive for large ranges.
+      // Stops between chunks when the StateImpl is left (no rows are built for a discarded or covered StateImpl).
+      static runtime::Task<Msg> load_ux(std::weak_ptr<RBDsState> state,RBDStore all_rbds,RangePartition::Range range,std::stop_token token) {
+        auto const CHUNK_SIZE = std::size_t{64*1024};
+        while (not token.stop_requested()) {
+          auto self = state.lock();
+          if (self == nullptr) co_return; // Discarded
+          auto const begin = range.first + self->m_loaded;
+          if (begin >= range.second) co_return; // All loaded
+          auto const end = std::min(begin+CHUNK_SIZE,range.second);
+          self->m_loaded += end - begin;
+          co_yield runtime::memory::make_pooled<AppendUXMsg>(self,build_rows(*all_rbds,begin,end));
+        }
+      }
+
+      virtual Cmd on_enter(State const& self,std::stop_token token) {
+        if (m_loaded == m_partition.size()) return Nop;
+        return load_ux(std::static_pointer_cast<RBDsState>(self),m_all_rbds,m_partition.m_range,std::move(token));
+      }
+  
+    };
+  
+    struct May2AprilState : public StateImpl {
+      static RBDsState::RBDStore all_rbds() {
+        static auto const result = std::make_shared<RBDsState::RBDs const>(RBDsState::RBDs{
+           "RBD #0"
+          ,"RBD #1"
+          ,"RBD #2"
+          ,"RBD #3"
+          ,"RBD #4"
+          ,"RBD #5"
+          ,"RBD #6"
+          ,"RBD #7"
+          ,"RBD #8"
+          ,"RBD #9"
+          ,"RBD #10"
+          ,"RBD #11"
+          ,"RBD #12"
+          ,"RBD #13"
+          ,"RBD #14"
+          ,"RBD #15"
+          ,"RBD #16"
+          ,"RBD #17"
+          ,"RBD #18"
+          ,"RBD #19"
+          ,"RBD #20"
+          ,"RBD #21"
+          ,"RBD #22"
+          ,"RBD #23"
+        });
+        return result;
+      }
+      StateFactory RBDs_factory = []() {
+        return runtime::memory::make_pooled<RBDsState>(all_rbds());
+      };
+      // All RBDs one key away (fanout of all option keys)
+      StateFactory RBDs_balanced_factory = []() {
+        return runtime::memory::make_pooled<RBDsState>(all_rbds(),RangePartition(*all_rbds(),RangePartition::KEYS.size(),RangePartition::Strategy::Balanced));
+      };
+      May2AprilState(StateImpl::UX ux) : StateImpl{ux} {
+        this->add_option('0',{"RBD:s",RBDs_factory});
+        this->add_option('1',{"RBD:s (one key each)",RBDs_balanced_factory});
+      }
+    };
+  
+    struct VATReturnsState : public StateImpl {
+      VATReturnsState(StateImpl::UX ux) : StateImpl{ux} {}
+    };
+
+    // The lines of a growing record file. New lines are appended live while it is the top StateImpl (see subscriptions).
+    struct RecordsState : public StateImpl {
+      static constexpr std::string_view PATH{"logs/records.txt"};
+      std::filesystem::path m_path;
+      std::uintmax_t m_offset{}; // Bytes of the complete lines read
+
+      RecordsState(std::filesystem::path path) : StateImpl({}), m_path{std::move(path)} {
+        // Watchable before the first record is written
+        std::filesystem::create_directories(m_path.parent_path());
+        std::ofstream{m_path, std::ios::app};
+        ux().push_back(std::format("Records {}",m_path.string()));
+        auto rows = read_new_lines();
+        ux().insert(ux().end(),std::make_move_iterator(rows.begin()),std::make_move_iterator(rows.end()));
+      }
+
+      // The complete lines appended since the last read (from the start again if the file was truncated)
+      std::vector<std::string> read_new_lines() {
+        std::error_code ec{};
+        if (auto size = std::filesystem::file_size(m_path,ec); not ec and size < m_offset) m_offset = 0;
+        std::vector<std::string> result{};
+        std::ifstream file{m_path, std::ios::binary};
+        file.seekg(static_cast<std::streamoff>(m_offset));
+        std::string line{};
+        while (std::getline(file,line) and not file.eof()) { // At eof the line is not complete yet
+          m_offset += line.size() + 1;
+          result.push_back(std::move(line));
+        }
+        return result;
+      }
+    };
+  
+    using Q1 = Menu<"Q1 UX goes here"
+      ,Item<'0',"VAT Returns",Dynamic<VATReturnsState,"VAT Returns UX goes here">>>;
+
+    template <Text UX>
+    using Project = Menu<UX
+      ,Item<'0',"May to April",Dynamic<May2AprilState,"May to April">>
+      ,Item<'1',"Q1",Q1>>;
+
+    using Workspace = Menu<"Workspace UX"
+      ,Item<'0',"ITfied AB",Project<"ITfied UX">>
+      ,Item<'1',"Org x",Project<"Other Organisation UX">>>;
+
+    struct FrameworkState : public StateImpl {
+      FrameworkState(StateImpl::UX ux) : StateImpl{ux} {
+        this->add_option('0',{"Workspace x",&Workspace::make},Workspace::prebuilt);
+        this->add_option('1',{"Records",[] {return std::make_shared<RecordsState>(RecordsState::PATH);}});
+      }
+  
+      virtual std::pair<std::optional<State>,Cmd> update(Msg const& msg) {
+        std::optional<State> new_state{};
+        auto key_msg_ptr = std::dynamic_pointer_cast<NCursesKey>(msg);
+        if (key_msg_ptr != nullptr) {
+          auto ch = key_msg_ptr->key;
+          if (ch == '+') {
+            this->m_ux.back().push_back('+');
+            new_state = std::make_shared<FrameworkState>(*this);          
+          }
+        }
+        return {new_state,Nop};
+      }
+  
+    };
+  
+    inline auto const framework_state_factory = []() {
+      auto framework_ux = StateImpl::UX{
+        "Framework UX"
+      };
+      return std::make_shared<FrameworkState>(framework_ux);
+    };
+  
+    // The first UX row shown when scrolled to row scroll (the last page stays full)
+    inline std::size_t first_row(std::size_t scroll,std::size_t rows,std::size_t page) {
+      return std::min(scroll,rows > page ? rows - page : 0);
+    }
+
+    // The visible UX text of state, page rows from row first (rows are only appended, so rows identifies its version)
+    inline std::string ux_text(State const& state,std::size_t rows,std::size_t first,std::size_t page) {
+      std::string result{};
+      for (std::size_t i=first;i<std::min(first+page,rows);++i) {
+        if (i>first) result.push_back('\n');
+        result += state->ux()[i];
+      }
+      return result;
+    }
+
+    struct Model {
+      using Text = std::shared_ptr<std::string const>;
+      Text top_content;
+      Text main_content;
+      std::string user_input;
+      /*
+      The stack contains the 'path of states' the user has navigated to.
+      */
+      std::stack<State,std::vector<State>> stack{}; // A moved std::deque allocates (the Model is moved each update)
+      /*
+      The pending StateImpl transition (if any), and the input that came after it (type-ahead, paste).
+      That input waits for the transition, so it applies to the StateImpl pushed, as if typed one key at a time.
+      */
+      std::string transition_key{};
+      std::vector<Msg> typed_ahead{};
+      /*
+      The on_enter Cmd of the top StateImpl. Stopped when another StateImpl becomes the top.
+      A new stop_source is only made when a Cmd got the token (most StateImpls have none).
+      */
+      std::stop_source entered{};
+      bool entered_cmd{};
+      /*
+      The option keys taken from the root StateImpl to the top (what a snapshot saves).
+      One entry per pushed StateImpl, so '-' pops all keys of a jump.
+      */
+      std::vector<std::string> keys{};
+      /*
+      The UX row scrolled to (clamped when shown, so it may be ahead of rows still loading), and the rows shown.
+      */
+      std::size_t scroll{};
+      std::size_t page{10};
+      /*
+      The top panel text, memoized on the top StateImpl (a prompt keystroke does not rebuild it).
+      Only the visible UX rows are joined, however many the StateImpl has.
+      */
+      runtime::Selector<std::string,State,std::size_t,std::size_t,std::size_t> top_selector{ux_text};
+    };
+  
+    // ----------------------------------
+    // Begin: Model
+    // ----------------------------------
+  
+    inline bool is_quit_msg(Msg const& msg) {
+      // std::cout << "\nis_quit_msg sais Hello" << std::flush;
+      return msg == QUIT_MSG;
+    }
+  
+    // ----------------------------------
+    // Begin: init,update,view
+    // ----------------------------------
+  
+    inline std::tuple<Model,runtime::IsQuit<Msg>,Cmd> init() {
+      // std::cout << "\ninit sais Hello :)" << std::flush;
+      Model model = { std::make_shared<std::string const>("Welcome to the top section")
+                     ,std::make_shared<std::string const>("This is the main content area")
+                     ,""};
+  
+      model.stack.push(framework_state_factory());
+      return {model,is_quit_msg,Nop};
+    }
+  
+    // Stops the on_enter Cmd of the StateImpl that is no longer the top (it resumes when entered again)
+    inline void leave(Model& model) {
+      if (not std::exchange(model.entered_cmd,false)) return;
+      model.entered.request_stop();
+      model.entered = std::stop_source{};
+    }
+
+    // The on_enter Cmd of the (new) top StateImpl
+    inline Cmd enter(Model& model) {
+      if (model.stack.empty()) return Nop;
+      auto cmd = model.stack.top()->on_enter(model.stack.top(),model.entered.get_token());
+      model.entered_cmd = model.entered_cmd or not runtime::is_nop(cmd);
+      return cmd;
+    }
+
+    // Makes state the top StateImpl, taken by the option keys keys. Returns its on_enter Cmd.
+    inline Cmd push_state(Model& model,State const& state,std::string keys) {
+      leave(model);
+      model.stack.push(state);
+      model.keys.push_back(std::move(keys));
+      model.scroll = 0;
+      return enter(model);
+    }
+
+    // Key and scroll Msgs (what the user typed)
+    inline bool is_input(Msg const& msg) {
+      return dynamic_cast<NCursesKey const*>(msg.get()) != nullptr or dynamic_cast<ScrollMsg const*>(msg.get()) != nullptr;
+    }
+
+    inline Cmd apply_msg(Model& model, Msg const& msg); // Forward
+
+    // Applies the input held while a transition was pending, up to the next transition it starts.
+    // Returns cmd and the Cmds of the applied input.
+    inline Cmd apply_typed_ahead(Model& model, Cmd cmd) {
+      if (model.typed_ahead.empty()) return cmd;
+      std::vector<Cmd> cmds{cmd};
+      auto held = std::exchange(model.typed_ahead,{});
+      auto iter = held.begin();
+      for (;iter != held.end() and model.transition_key.empty();++iter) cmds.push_back(apply_msg(model,*iter));
+      model.typed_ahead.assign(iter,held.end());
+      return Cmd::batch(std::move(cmds));
+    }
+
+    // Applies msg to model and returns the resulting command (leaves the UX content as is)
+    inline Cmd apply_msg(Model& model, Msg const& msg) {
+  
+      if (not model.transition_key.empty() and is_input(msg)) {
+        model.typed_ahead.push_back(msg); // Applied once the transition is pushed
+        return Nop;
+      }
+      Cmd cmd = Nop;
+      std::optional<State> new_state{};
+      if (model.stack.size()>0) {
+        auto pp = model.stack.top()->update(msg);
+        new_state = pp.first;
+        cmd = pp.second;
+      }
+      if (new_state) {
+        // Let 'StateImpl' update itself
+        model.stack.top() = *new_state; // mutate
+      }
+      else {
+        // Process StateImpl transition or user input
+        if (auto key_msg_ptr = std::dynamic_pointer_cast<NCursesKey>(msg);key_msg_ptr != nullptr) {
+          auto ch = key_msg_ptr->key; 
+          if (ch == KEY_BACKSPACE || ch == 127) { // Handle backspace
+            if (!model.user_input.empty()) {
+              model.user_input.pop_back();
+            }
+          } 
+          else if (ch == '\n') {
+            // User pressed Enter: process command (optional)
+            if (model.stack.size() > 0) {
+              if (auto jump = model.stack.top()->jump(model.user_input)) {
+                // Straight to the target StateImpl (no intermediate StateImpls are built)
+                cmd = push_state(model,jump->state,std::move(jump->keys));
+              }
+            }
+            model.user_input.clear(); // Reset input after submission
+          } 
+          else {
+            if ((model.user_input.empty() and ch == 'q') or model.stack.size()==0) {
+              // std::cout << "\nTime to QUIT!" << std::flush;
+              cmd = DO_QUIT;
+            }
+            else if (model.user_input.empty() and model.stack.size() > 0) {
+              if (ch == '-') {
+                // (1) Transition back to old StateImpl
+                leave(model);
+                model.stack.pop();
+                if (not model.keys.empty()) model.keys.pop_back();
+                model.scroll = 0;
+                cmd = enter(model); // Resumes its loading (or starts it for a restored StateImpl)
+              } 
+              else if (model.stack.top()->options().contains(ch) and model.stack.top()->options().at(ch).prebuilt) {
+                // (2) Transition to a static Menu (built once, so pushed at once)
+                cmd = push_state(model,model.stack.top()->options().at(ch).factory(),std::string(1,static_cast<char>(ch)));
+              }
+              else if (model.stack.top()->options().contains(ch)) {
+                // (3) Transition to new StateImpl.
+                // The input after it waits until it is pushed (see Model::typed_ahead), and the same transition
+                // queued again (the same key on the same top) is coalesced. The expensive part, loading the new
+                // StateImpl, is its on_enter Cmd (stopped by leave).
+                auto key = std::format("PushState {} {}",static_cast<void const*>(model.stack.top().get()),ch);
+                model.transition_key = key;
+                cmd = Cmd{key,std::stop_token{},[ch,parent = model.stack.top()]() -> std::optional<Msg> {
+                  State new_state = parent->options().at(ch).factory();
+                  auto msg = runtime::memory::make_pooled<PushStateMsg>(parent,static_cast<char>(ch),new_state);
+                  return msg;
+                }};
+              }
+              else {
+                model.user_input += ch; // Append typed character
+              }
+            }
+            else {
+                model.user_input += ch; // Append typed character
+            }
+          }
+        }    
+        else if (auto pimpl = std::dynamic_pointer_cast<PushStateMsg>(msg);pimpl != nullptr) {
+          if (model.stack.size() > 0 and model.stack.top() == pimpl->m_parent) {
+            // The transition matches
+            model.transition_key.clear();
+            cmd = apply_typed_ahead(model,push_state(model,pimpl->m_state,std::string(1,pimpl->m_key)));
+          }
+          else {
+            model.user_input.push_back('?');
+            model.transition_key.clear();
+            cmd = apply_typed_ahead(model,Nop);
+          }
+        }    
+        else if (auto pimpl = std::dynamic_pointer_cast<ScrollMsg>(msg);pimpl != nullptr) {
+          if (pimpl->page > 0) model.page = static_cast<std::size_t>(pimpl->page);
+          if (model.stack.size() > 0) {
+            auto const first = static_cast<std::ptrdiff_t>(first_row(model.scroll,model.stack.top()->ux().size(),model.page));
+            model.scroll = static_cast<std::size_t>(std::max<std::ptrdiff_t>(first + pimpl->lines,0));
+          }
+        }
+        else if (auto pimpl = std::dynamic_pointer_cast<AppendUXMsg>(msg);pimpl != nullptr) {
+          auto& ux = pimpl->m_state->ux();
+          ux.insert(ux.end(),std::make_move_iterator(pimpl->m_rows.begin()),std::make_move_iterator(pimpl->m_rows.end()));
+        }
+      }
+      return cmd;
+    }
+
+    // Selects the UX content of the current StateImpl (recomputed only when it changed)
+    inline void refresh_ux(Model& model) {
+      if (model.stack.size() > 0) {
+        auto const& top = model.stack.top();
+        // StateImpl UX (top window)
+        auto const rows = top->ux().size();
+        if (top->m_shared) {
+          model.top_content = Model::Text{top,&top->ux().front()}; // Its one row, never changed (a static Menu)
+        }
+        else {
+          model.top_content = model.top_selector(top,rows,first_row(model.scroll,rows,model.page),model.page);
+        }
+        // StateImpl transition UX (Midle window), pre-rendered (an alias kept alive by top)
+        model.main_content = Model::Text{top,&top->options().text()};
+      }
+    }
+
+    // A live view of the record file while its RecordsState is the top StateImpl
+    inline runtime::Subscriptions<Msg> subscriptions(Model const& model) {
+      if (model.stack.empty()) return {};
+      auto records = std::dynamic_pointer_cast<RecordsState>(model.stack.top());
+      if (records == nullptr) return {};
+      return {{"records",runtime::FileWatch{records->m_path},[weak = std::weak_ptr<RecordsState>{records}]() -> std::optional<Msg> {
+        auto state = weak.lock();
+        if (state == nullptr) return std::nullopt;
+        auto rows = state->read_new_lines();
+        if (rows.empty()) return std::nullopt;
+        return Msg{runtime::memory::make_pooled<AppendUXMsg>(state,std::move(rows))};
+      }}};
+    }
+
+    // The subscriptions change only with the top StateImpl
+    inline std::size_t subscriptions_key(Model const& model) {
+      return model.stack.empty() ? 0 : std::hash<StateImpl const*>{}(model.stack.top().get());
+    }
+
+    inline std::pair<Model,Cmd> update(Model model, Msg msg) {
+      auto cmd = apply_msg(model,msg);
+      refresh_ux(model);
+      return {std::move(model),cmd}; // Return updated model
+    }
+
+    // Folds all msgs into model and rebuilds the UX content only once
+    inline std::pair<Model,std::vector<Cmd>> update_batch(Model&& model, std::span<const Msg> msgs) {
+      std::vector<Cmd> cmds{};
+      for (auto const& msg : msgs) {
+        if (auto cmd = apply_msg(model,msg); not runtime::is_nop(cmd)) cmds.push_back(cmd);
+      }
+      refresh_ux(model);
+      return {std::move(model),cmds};
+    }
+
+    // Snapshot: the navigation path, the prompt and the UX scroll position
+    inline void save(Model const& model,runtime::SnapshotWriter& out) {
+      out.varint(model.keys.size());
+      for (auto const& keys : model.keys) out.str(keys);
+      out.str(model.user_input);
+      out.varint(model.scroll);
+    }
+
+    // Rebuilds only the StateImpls on the saved path. Nullopt if the path no longer exists.
+    inline std::optional<Cmd> restore(Model& model,runtime::SnapshotReader& in) {
+      auto const count = in.varint();
+      if (count > in.remaining()) return std::nullopt; // Corrupt, every key takes a byte at least
+      std::vector<std::string> keys(count);
+      for (auto& entry : keys) entry = in.str();
+      auto user_input = in.str();
+      auto scroll = in.empty() ? 0 : in.varint(); // Not in snapshots before scrolling
+      for (auto const& entry : keys) {
+        if (model.stack.empty() or entry.empty()) return std::nullopt;
+        auto const ch = static_cast<unsigned char>(entry.front());
+        if (entry.size() == 1 and model.stack.top()->options().contains(ch)) {
+          model.stack.push(model.stack.top()->options().at(ch).factory());
+        }
+        else if (auto jump = model.stack.top()->jump("/" + entry)) {
+          model.stack.push(jump->state); // One StateImpl, as when it was jumped to
+        }
+        else return std::nullopt;
+      }
+      model.keys = std::move(keys);
+      model.user_input = std::move(user_input);
+      model.scroll = scroll; // Applies as the rows load
+      refresh_ux(model);
+      return enter(model);
+    }
+    static_assert(runtime::Snapshottable<Model,Cmd>);
+  
+    inline Html_Msg<Msg> view(const Model &model) {
+      // std::cout << "\nview sais Hello :)" << std::flush;
+  
+      // Create a new pugi document
+      Html_Msg<Msg> ui{};
+      auto& doc = ui.doc;
+  
+      // Note: HTML doc may be tested for validity at:
+      // https://www.w3schools.com/html/tryit.asp?filename=tryhtml_intro
+  
+      // Create the root HTML element
+      pugi::xml_node html = doc.append_child("html");
+  
+      // Create the body
+      pugi::xml_node body = html.append_child("body");
+  
+      // Create the top section with class "content"
+      pugi::xml_node top = body.append_child("div");
+      top.append_attribute("class") = "content";
+      ui.set_text_ref(top,*model.top_content);
+      if (model.stack.size() > 0) {
+        auto const rows = model.stack.top()->ux().size();
+        ui.set_window(top,first_row(model.scroll,rows,model.page),rows);
+      }
+  
+      // Create the main section with class "content"
+      pugi::xml_node main = body.append_child("div");
+      main.append_attribute("class") = "content";
+      ui.set_text_ref(main,*model.main_content);
+  
+      // Create the user prompt section with class "user-prompt"
+      pugi::xml_node prompt = body.append_child("div");
+      prompt.append_attribute("class") = "user-prompt";
+      // Add a label element for the prompt text
+      pugi::xml_node label = prompt.append_child("label");
+      label.text().set((">" + model.user_input).c_str());
+  
+      // Make prompt 'html-correct' (even though render does not care for now)
+      pugi::xml_node input = prompt.append_child("input");
+      input.append_attribute("type") = "text";
+      input.append_attribute("id") = "command";
+      input.append_attribute("name") = "command";
+  
+      ui.event_handlers["OnKey"] = onKey;
+      ui.event_handlers["OnScroll"] = onScroll; // PgUp/PgDn
+      return ui;
+    }
+  
+    // ----------------------------------
+    // End: init,update,view
+    // ----------------------------------
+} // namespace first
@@ -0,0 +1,1055 @@
+// Runtime tests on the headless backend (no terminal). Run by ctest, or directly: runtime_test [name]
+// Counts heap allocations (see stratoceph/runtime/alloc_profile.hpp), so allocation budgets can be tested.
+#define STRATOCEPH_ALLOC_PROFILE_NEW
+#include "stratoceph/runtime/alloc_profile.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <queue>
+#include <ranges>
+#include <stdexcept>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/null_sink.h>
+#include "stratoceph/runtime/runtime.hpp"
+#include "stratoceph/runtime/headless.hpp"
+#include "stratoceph/runtime/selector.hpp"
+#include "first.hpp"
+
+#ifdef __linux__
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "stratoceph/wire/html_msg.hpp"
+#endif
+
+namespace {
+
+  // Throws (fails the running test) unless ok
+  void check(bool ok, std::string_view what) {
+    if (not ok) throw std::runtime_error(std::format("check failed: {}",what));
+  }
+
+  // A directory of its own for files a test writes
+  std::filesystem::path scratch(std::string_view name) {
+    auto result = std::filesystem::temp_directory_path() / std::format("stratoceph_runtime_test_{}",name);
+    std::filesystem::remove_all(result);
+    std::filesystem::create_directories(result);
+    return result;
+  }
+
+  // A model counting its Msgs (the last one kept)
+  struct Counted {
+    int msgs{};
+    int last{};
+  };
+  using Msg = int;
+  using Cmd = std::function<std::optional<Msg>()>;
+  using App = Runtime<Counted,Msg,Cmd,runtime::Headless>;
+
+  std::tuple<Counted,runtime::IsQuit<Msg>,Cmd> init_counted() {
+    return {Counted{},[](Msg const& msg) {return msg == 'q';},Cmd{}};
+  }
+
+  Html_Msg<Msg> view_counted(Counted const&) {
+    Html_Msg<Msg> ui{};
+    ui.event_handlers["OnKey"] = [](Event event) -> std::optional<Msg> {return std::stoi(event["Key"]);};
+    return ui;
+  }
+
+  std::pair<Counted,Cmd> update_counted(Counted model, Msg msg) {
+    ++model.msgs;
+    model.last = msg;
+    return {model,Cmd{}};
+  }
+
+  // Snapshots (see runtime/snapshot.hpp)
+  void save(Counted const& model, runtime::SnapshotWriter& out) {
+    out.varint(static_cast<std::uint64_t>(model.msgs));
+  }
+
+  std::optional<Cmd> restore(Counted& model, runtime::SnapshotReader& in) {
+    model.msgs = static_cast<int>(in.varint());
+    return Cmd{};
+  }
+
+  // ----------------------------------
+  // Begin: Batch update
+  // ----------------------------------
+
+  // Keys read together (type-ahead, paste) reach update_batch in one call, and its Nop Cmds are never queued
+  void update_batch_drains_queue() {
+    std::vector<std::size_t> batches{};
+    std::size_t queued{};
+    App app{init_counted,view_counted,update_counted,[&batches](Counted&& model, std::span<const Msg> msgs) {
+      batches.push_back(msgs.size());
+      for (auto msg : msgs) model = update_counted(model, msg).first;
+      return std::pair{std::move(model),std::vector<Cmd>{Cmd{},[] {return std::optional<Msg>{};},Cmd{}}};
+    }};
+    app.on_pump([&queued](runtime::QueueDepths const& depths) {queued = std::max(queued,depths.cmd);});
+    int step{};
+    app.run(0,nullptr,[&step](std::vector<int>& keys) {
+      if (step == 0) keys.insert(keys.end(),{'1','2','3','4','5'});
+      return ++step < 5;
+    });
+    check(batches == std::vector<std::size_t>{5},std::format("one update for the five keys, batches:{}",batches.size()));
+    check(queued == 1,std::format("only the Cmd queued (not the Nops), queued:{}",queued));
+  }
+
+  // ----------------------------------
+  // End: Batch update
+  // ----------------------------------
+
+  // ----------------------------------
+  // Begin: Subscriptions
+  // ----------------------------------
+
+  void file_watch_delivers_msg() {
+    auto const path = scratch("file_watch") / "records.txt";
+    std::ofstream{path} << "first\n";
+    int delivered{};
+    int declared{};
+    App app{init_counted,view_counted,update_counted,{},[&](Counted const&) {
+      ++declared;
+      return runtime::Subscriptions<Msg>{{"records",runtime::FileWatch{path},[&]() -> std::optional<Msg> {
+        ++delivered;
+        return 'r';
+      }}};
+    }};
+    app.set_subscriptions_key([](Counted const&) -> std::size_t {return 1;}); // Never changes
+    int step{};
+    app.run(0,nullptr,[&](std::vector<int>& keys) {
+      if (step == 1) std::ofstream{path,std::ios::app} << "appended\n";
+      if (delivered > 0 or step > 1000) keys.push_back('q');
+      if (step > 0) std::this_thread::sleep_for(std::chrono::milliseconds{1});
+      ++step;
+      return true;
+    });
+    check(delivered > 0,"a Msg for the appended record");
+    check(declared == 1,std::format("subscriptions declared once (not per update), declared:{}",declared));
+  }
+
+  // A file created after the watch, and replaced (rotated) by a new one, is followed
+  void file_watch_follows_rotation() {
+    auto const path = scratch("file_watch_rotation") / "records.txt";
+    int delivered{};
+    App app{init_counted,view_counted,update_counted,{},[&](Counted const&) {
+      return runtime::Subscriptions<Msg>{{"records",runtime::FileWatch{path},[&]() -> std::optional<Msg> {
+        ++delivered;
+        return 'r';
+      }}};
+    }};
+    app.set_subscriptions_key([](Counted const&) -> std::size_t {return 1;});
+    int step{};
+    int phase{};
+    int settled{}; // Deliveries before the append to the new file
+    app.run(0,nullptr,[&](std::vector<int>& keys) {
+      if (phase == 0 and step == 1) std::ofstream{path} << "first\n";
+      if (phase == 0 and delivered > 0) {
+        std::filesystem::rename(path, std::filesystem::path{path} += ".1");
+        std::ofstream{path};
+        phase = 1;
+        step = 0;
+      }
+      if (phase == 1 and step == 20) {
+        settled = delivered;
+        std::ofstream{path,std::ios::app} << "second\n";
+        phase = 2;
+      }
+      if ((phase == 2 and delivered > settled) or step > 1000) keys.push_back('q');
+      std::this_thread::sleep_for(std::chrono::milliseconds{1});
+      ++step;
+      return true;
+    });
+    check(phase == 2,"a Msg for the file created after the watch");
+    check(delivered > settled,"a Msg for the append to the new file");
+  }
+
+  void every_rejects_zero_interval() {
+    App app{init_counted,view_counted,update_counted,{},[](Counted const&) {
+      return runtime::Subscriptions<Msg>{{"tick",runtime::Every{std::chrono::milliseconds{0}},[]() -> std::optional<Msg> {return 't';}}};
+    }};
+    std::string failure{};
+    try {app.run(0,nullptr,[](std::vector<int>&) {return false;});}
+    catch (std::runtime_error const& e) {failure = e.what();}
+    check(failure.contains("'tick'") and failure.contains("non-positive"),std::format("rejected (it would never fire), failure:'{}'",failure));
+  }
+
+#ifdef __linux__
+  void fd_waited_twice_reported() {
+    int fds[2];
+    check(::pipe2(fds,O_NONBLOCK) == 0,"pipe");
+    App app{init_counted,view_counted,update_counted,{},[&fds](Counted const&) {
+      return runtime::Subscriptions<Msg>{{"a",runtime::FdReadable{fds[0]},{}},{"b",runtime::FdReadable{fds[0]},{}}};
+    }};
+    std::string failure{};
+    try {app.run(0,nullptr,[](std::vector<int>&) {return false;});}
+    catch (std::runtime_error const& e) {failure = e.what();}
+    ::close(fds[0]);
+    ::close(fds[1]);
+    check(failure.contains("already waited for"),std::format("a clear error, failure:'{}'",failure));
+  }
+#endif
+
+  // ----------------------------------
+  // End: Subscriptions
+  // ----------------------------------
+
+  // ----------------------------------
+  // Begin: Selectors
+  // ----------------------------------
+
+  void const_selector_memoizes() {
+    runtime::Selector<std::string,int> const selector{[](int const& n) {return std::string(static_cast<std::size_t>(n),'x');}};
+    auto const first = selector(3); // Shared
+    check(*first == "xxx" and selector(3) == first,"the same input is not recomputed");
+    check(*selector(4) == "xxxx" and selector.computations() == 2,"a changed input is recomputed");
+  }
+
+  // ----------------------------------
+  // End: Selectors
+  // ----------------------------------
+
+  // ----------------------------------
+  // Begin: Snapshots
+  // ----------------------------------
+
+  void snapshot_save_failure_retried() {
+    auto const directory = scratch("snapshot") / "missing";
+    auto const path = directory / "session.snapshot";
+    App app{init_counted,view_counted,update_counted};
+    app.set_snapshot(path, std::chrono::milliseconds{1});
+    auto const level = spdlog::get_level();
+    spdlog::set_level(spdlog::level::off); // The failed saves are logged as warnings
+    int step{};
+    app.run(0,nullptr,[&](std::vector<int>& keys) {
+      if (step == 20) std::filesystem::create_directories(directory);
+      keys.push_back('1');
+      std::this_thread::sleep_for(std::chrono::milliseconds{1});
+      return ++step < 1000 and not std::filesystem::exists(path); // Ends the session (keeps the snapshot)
+    });
+    spdlog::set_level(level);
+    check(step > 20,"the session outlived failed saves");
+    check(std::filesystem::exists(path),"saved once the directory exists");
+  }
+
+#ifdef __linux__
+  // An error on flushing the file (here a full disk) fails the save and leaves the previous snapshot
+  void snapshot_write_error_reported() {
+    auto const path = scratch("snapshot_full") / "session.snapshot";
+    runtime::save_snapshot(path, Counted{.msgs = 1});
+    auto temporary = path;
+    temporary += ".tmp";
+    std::filesystem::create_symlink("/dev/full", temporary);
+    bool thrown{};
+    try {runtime::save_snapshot(path, Counted{.msgs = 2});}
+    catch (std::runtime_error const&) {thrown = true;}
+    std::filesystem::remove(temporary);
+    check(thrown,"the failed write reported");
+    Counted restored{};
+    check(runtime::restore_snapshot<Cmd>(path, restored) and restored.msgs == 1,"the previous snapshot kept");
+  }
+#endif
+
+  // ----------------------------------
+  // End: Snapshots
+  // ----------------------------------
+
+  // ----------------------------------
+  // Begin: Tasks
+  // ----------------------------------
+
+  using Task = runtime::Task<Msg>;
+  using Scheduler = runtime::Scheduler<Msg>;
+
+  // Runs the scheduler until no Task is left (or steps run out), and returns the yielded Msgs
+  std::vector<Msg> drain(Scheduler& scheduler, int steps = 100) {
+    std::queue<Msg> msg_q{};
+    while (scheduler.size() > 0 and steps-- > 0) {
+      if (auto ms = scheduler.timeout_ms(); not scheduler.has_ready() and ms > 0) std::this_thread::sleep_for(std::chrono::milliseconds{ms});
+      scheduler.wake_expired();
+      scheduler.run_ready(msg_q);
+    }
+    std::vector<Msg> result{};
+    for (; not msg_q.empty(); msg_q.pop()) result.push_back(msg_q.front());
+    return result;
+  }
+
+  Task child_task(int first) {
+    co_yield first;
+    co_await runtime::sleep_for(std::chrono::milliseconds{1});
+    co_yield first + 1;
+  }
+
+  Task parent_task() {
+    co_yield 1;
+    co_await child_task(2);
+    co_yield 4;
+    co_await child_task(5);
+  }
+
+  void task_awaits_task() {
+    Scheduler scheduler{};
+    scheduler.spawn(parent_task());
+    auto msgs = drain(scheduler);
+    check(msgs == std::vector<Msg>{1,2,3,4,5,6},"parent resumed after each child, all yields delivered in order");
+    check(scheduler.size() == 0,"done");
+  }
+
+  Task throwing_child() {
+    co_yield 1;
+    throw std::runtime_error("child");
+  }
+
+  Task catching_parent() {
+    bool caught{false};
+    try {
+      co_await throwing_child();
+    }
+    catch (std::runtime_error const&) {
+      caught = true;
+    }
+    if (caught) co_yield 2;
+  }
+
+  void task_awaits_throwing_task() {
+    Scheduler scheduler{};
+    scheduler.spawn(catching_parent());
+    check(drain(scheduler) == std::vector<Msg>{1,2},"the child exception is rethrown in the parent");
+  }
+
+  Task counting_task() {
+    for (int i=0;true;++i) co_yield i;
+  }
+
+  void task_cmd_cancelled() {
+    std::stop_source source{};
+    runtime::Cmd<Msg> cmd{"count",source.get_token(),counting_task()};
+    Scheduler scheduler{};
+    scheduler.spawn(std::move(*cmd.task()));
+    std::queue<Msg> msg_q{};
+    scheduler.run_ready(msg_q);
+    scheduler.run_ready(msg_q);
+    check(msg_q.size() == 2,"runs until stopped");
+    source.request_stop();
+    scheduler.run_ready(msg_q);
+    check(msg_q.size() == 2 and scheduler.size() == 0,"dropped once stopped");
+  }
+
+  void task_cmd_runs_once() {
+    runtime::Cmd<Msg> cmd{counting_task()};
+    auto copy = cmd;
+    Scheduler scheduler{};
+    scheduler.spawn(std::move(*cmd.task()));
+    scheduler.spawn(std::move(*copy.task())); // The same (moved out) Task
+    check(scheduler.size() == 1,"a moved out Task is ignored");
+  }
+
+  Task throwing_task() {
+    throw std::runtime_error("task");
+    co_return;
+  }
+
+  void task_exception_keeps_others() {
+    Scheduler scheduler{};
+    scheduler.spawn(throwing_task());
+    scheduler.spawn(counting_task());
+    std::queue<Msg> msg_q{};
+    bool thrown{false};
+    try {scheduler.run_ready(msg_q);} catch (std::runtime_error const&) {thrown = true;}
+    check(thrown,"the exception is rethrown");
+    check(msg_q.size() == 1 and scheduler.size() == 1,"the other Task ran its step and is kept");
+  }
+
+#ifdef __linux__
+  Task reading_task(int fd, Msg msg) {
+    co_await runtime::readable(fd);
+    co_yield msg;
+  }
+
+  void tasks_await_same_fd() {
+    int fds[2];
+    check(::pipe2(fds,O_NONBLOCK) == 0,"pipe");
+    {
+      runtime::Poller poller{};
+      Scheduler scheduler{poller};
+      scheduler.spawn(reading_task(fds[0],1));
+      scheduler.spawn(reading_task(fds[0],2));
+      std::queue<Msg> msg_q{};
+      scheduler.run_ready(msg_q); // Both park on fds[0] (one poller registration)
+      check(scheduler.size() == 2,"both wait");
+      check(::write(fds[1],"x",1) == 1,"write");
+      for (auto fd : poller.wait(1000)) scheduler.dispatch(fd);
+      scheduler.run_ready(msg_q);
+      check(msg_q.size() == 2,"both woken");
+    }
+    ::close(fds[0]);
+    ::close(fds[1]);
+  }
+#endif
+
+  // ----------------------------------
+  // End: Tasks
+  // ----------------------------------
+
+  // ----------------------------------
+  // Begin: Serve
+  // ----------------------------------
+
+#ifdef __linux__
+  // A server session backend. Keys are the bytes sent by the client, and each frame writes "frame <n>\n"
+  class Piped {
+  public:
+    Piped(FILE* out, FILE* in) : m_out{out}, m_in_fd{fileno(in)} {}
+    void render(pugi::xml_document const&, std::span<std::string_view const> = {}) {
+      std::fprintf(m_out, "frame %zu\n", ++m_frames);
+      std::fflush(m_out);
+    }
+    void read_keys(std::vector<int>& keys) {
+      char buffer[64];
+      for (ssize_t n{}; (n = ::recv(m_in_fd, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0;) keys.insert(keys.end(), buffer, buffer + n);
+    }
+    int input_fd() const {return m_in_fd;}
+  private:
+    FILE* m_out;
+    int m_in_fd;
+    std::size_t m_frames{};
+  };
+
+  int connect_to(std::filesystem::path const& path) {
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::snprintf(address.sun_path, sizeof(address.sun_path), "%s", path.c_str());
+    for (int i=0;i<100;++i) {
+      if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0) return fd;
+      std::this_thread::sleep_for(std::chrono::milliseconds{10}); // Not listening yet
+    }
+    throw std::runtime_error(std::format("connect to {} failed",path.string()));
+  }
+
+  // What the server sent within timeout_ms (nullopt once it closed the connection)
+  std::optional<std::string> receive(int fd, int timeout_ms = 500) {
+    std::string result{};
+    pollfd ready{fd, POLLIN, 0};
+    while (::poll(&ready, 1, timeout_ms) > 0) {
+      char buffer[256];
+      auto n = ::recv(fd, buffer, sizeof(buffer), 0);
+      if (n <= 0) return std::nullopt;
+      result.append(buffer, static_cast<std::size_t>(n));
+      timeout_ms = 50; // The rest of a burst
+    }
+    return result;
+  }
+
+  void serve_drops_failing_session() {
+    auto const path = scratch("serve") / "socket";
+    using PipedApp = Runtime<Counted,Msg,Cmd,Piped>;
+    PipedApp app{init_counted,view_counted,[](Counted model, Msg msg) {
+      if (msg == 'x') throw std::runtime_error("update failed");
+      return update_counted(model, msg);
+    }};
+    std::thread server{[&app,&path] {app.serve(path);}};
+    auto const level = spdlog::get_level();
+    spdlog::set_level(spdlog::level::off); // The dropped session is logged as an error
+    int a = connect_to(path);
+    int b = connect_to(path);
+    check(receive(a).value_or("").contains("frame 1"),"a first frame");
+    check(receive(b).value_or("").contains("frame 1"),"b first frame");
+    check(::send(b, "x", 1, 0) == 1,"b send");
+    check(not receive(b),"b dropped");
+    check(::send(a, "1", 1, 0) == 1,"a send");
+    check(receive(a).value_or("").contains("frame 2"),"a still served");
+    ::close(b);
+    ::close(a);
+    ::pthread_kill(server.native_handle(), SIGTERM);
+    server.join();
+    spdlog::set_level(level);
+    check(not std::filesystem::exists(path),"socket removed");
+  }
+
+  // A server session backend whose frames are larger than any socket buffer
+  class Bulky : public Piped {
+  public:
+    Bulky(FILE* out, FILE* in) : Piped{out, in}, m_out{out} {}
+    void render(pugi::xml_document const&, std::span<std::string_view const> = {}) {
+      std::string const frame(2*1024*1024, '.');
+      std::fwrite(frame.data(), 1, frame.size(), m_out);
+      std::fprintf(m_out, "frame %zu\n", ++m_frames);
+      std::fflush(m_out);
+    }
+  private:
+    FILE* m_out;
+    std::size_t m_frames{};
+  };
+
+  void serve_large_frames_and_signals() {
+    auto const path = scratch("serve_large") / "socket";
+    struct sigaction marker{};
+    marker.sa_handler = [](int) {};
+    struct sigaction before{};
+    ::sigaction(SIGPIPE, &marker, &before);
+    Runtime<Counted,Msg,Cmd,Bulky> app{init_counted,view_counted,update_counted};
+    std::thread server{[&app,&path] {app.serve(path);}};
+    int a = connect_to(path);
+    int b = connect_to(path);
+    check(receive(a).value_or("").ends_with("frame 1\n"),"a whole first frame");
+    check(receive(b).value_or("").ends_with("frame 1\n"),"b whole first frame");
+    check(::send(a, "1", 1, 0) == 1,"a send");
+    auto const frame = receive(a).value_or("");
+    check(frame.size() > 2*1024*1024 and frame.ends_with("frame 2\n"),"a whole second frame");
+    ::close(b);
+    ::close(a);
+    ::pthread_kill(server.native_handle(), SIGTERM);
+    server.join();
+    struct sigaction after{};
+    ::sigaction(SIGPIPE, &before, &after);
+    check(after.sa_handler == marker.sa_handler,"SIGPIPE handler restored");
+    ::sigaction(SIGTERM, nullptr, &after);
+    check(after.sa_handler == SIG_DFL,"SIGTERM handler restored");
+  }
+#endif
+
+  // ----------------------------------
+  // End: Serve
+  // ----------------------------------
+
+  // ----------------------------------
+  // Begin: Wire
+  // ----------------------------------
+
+#ifdef __linux__
+  // Shows the last Msg (as node text, and a referenced text)
+  Html_Msg<Msg> view_last(Counted const& model) {
+    auto ui = view_counted(model);
+    auto body = ui.doc.append_child("body");
+    body.append_child("p").text().set(std::to_string(model.last).c_str());
+    ui.set_text_ref(body.append_child("span"), "last");
+    return ui;
+  }
+
+  // A thin client renderer. Records the shown values, and sends the next key once the last one is shown.
+  class Remote {
+  public:
+    Remote(std::vector<int> script) : m_script{std::move(script)} {
+      if (::pipe(m_keys) != 0) throw std::runtime_error("pipe failed");
+    }
+    ~Remote() {
+      ::close(m_keys[0]);
+      ::close(m_keys[1]);
+    }
+    void render(pugi::xml_document const& doc, std::span<std::string_view const> = {}) {
+      auto body = doc.child("body");
+      m_shown.push_back(std::stoi(body.child("p").text().get()));
+      m_texts.push_back(body.child("span").text().get());
+      bool const acknowledged = (m_next == 0) or (m_shown.back() == m_script[m_next-1]);
+      if (acknowledged and m_next < m_script.size()) {
+        check(::write(m_keys[1], &m_script[m_next++], sizeof(int)) == sizeof(int),"key write");
+      }
+    }
+    void read_keys(std::vector<int>& keys) {
+      int key{};
+      if (::read(m_keys[0], &key, sizeof(key)) == sizeof(key)) keys.push_back(key);
+    }
+    int input_fd() const {return m_keys[0];}
+    std::vector<int> const& shown() const {return m_shown;}
+    std::vector<std::string> const& texts() const {return m_texts;}
+  private:
+    std::vector<int> m_script;
+    std::size_t m_next{};
+    int m_keys[2]{};
+    std::vector<int> m_shown{};
+    std::vector<std::string> m_texts{};
+  };
+
+  void remote_round_trip() {
+    int fds[2];
+    check(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == 0,"socketpair");
+    using RemoteApp = Runtime<Counted,Msg,Cmd,html_msg_wire::RemoteRenderer>;
+    std::thread server{[fd = fds[0]] {
+      RemoteApp app{init_counted,view_last,update_counted};
+      app.run(0,nullptr,fd,fd);
+      ::shutdown(fd, SHUT_RDWR); // Ends the client
+    }};
+    Remote client{{300,'q'}}; // 300 takes two varint bytes
+    html_msg_wire::render_remote(fds[1], client);
+    server.join();
+    ::close(fds[0]);
+    ::close(fds[1]);
+    check(not client.shown().empty() and client.shown().front() == 0,"the initial frame");
+    check(std::ranges::find(client.shown(), 300) != client.shown().end(),"the key sent back and applied");
+    check(std::ranges::all_of(client.texts(), [](auto const& text) {return text == "last";}),"referenced text inlined");
+  }
+
+  void decoder_rejects_malformed() {
+    auto rejects = [](std::string_view received) {
+      html_msg_wire::Decoder decoder{};
+      try {decoder.next_payload(received);}
+      catch (std::runtime_error const&) {return true;}
+      return false;
+    };
+    check(rejects(std::string(11,'\x80')),"a size varint longer than 10 bytes");
+    std::string oversized{};
+    wire::put_varint(oversized, html_msg_wire::Decoder::MAX_PAYLOAD + 1);
+    check(rejects(oversized),"a payload size above the cap");
+    std::string nodes{};
+    wire::put_varint(nodes, html_msg_wire::Decoder::MAX_NODES + 1);
+    wire::put_varint(nodes, 0);
+    html_msg_wire::Decoder decoder{};
+    bool thrown{};
+    try {decoder.apply(nodes);}
+    catch (std::runtime_error const&) {thrown = true;}
+    check(thrown,"a node count above the cap");
+    auto applies = [](std::vector<std::size_t> const& depths) {
+      std::string payload{};
+      wire::put_varint(payload, depths.size());
+      wire::put_varint(payload, depths.size());
+      for (std::size_t i=0;i<depths.size();++i) {
+        wire::put_varint(payload, i);
+        html_msg_wire::put_node(payload, {depths[i], "div"});
+      }
+      html_msg_wire::Decoder decoder{};
+      try {decoder.apply(payload);}
+      catch (std::runtime_error const&) {return false;}
+      return true;
+    };
+    check(applies({0,1,2,2,1,2}),"a well formed tree");
+    check(not applies({1,2}),"a root below depth 0");
+    check(not applies({0,1,3}),"a node below a missing parent");
+    check(not applies({0,1,0}),"a second root");
+  }
+
+  // A truncated or oversized key varint drops the client, it does not throw out of the session
+  void remote_rejects_malformed_key() {
+    for (std::string const& sent : {std::string(11,'\x80'),std::string{"\xff\xff\xff\xff\x7f"}}) {
+      int fds[2];
+      check(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == 0,"socketpair");
+      html_msg_wire::RemoteRenderer renderer{fds[0],fds[0]};
+      std::string keys_first{};
+      wire::put_varint(keys_first, 300);
+      check(::send(fds[1], (keys_first + sent).data(), keys_first.size() + sent.size(), 0) > 0,"send");
+      std::vector<int> keys{};
+      renderer.read_keys(keys);
+      check(keys == std::vector<int>{300} and not renderer.open(),"the keys before it, then the connection is closed");
+      ::close(fds[0]);
+      ::close(fds[1]);
+    }
+  }
+#endif
+
+  // ----------------------------------
+  // End: Wire
+  // ----------------------------------
+
+  // ----------------------------------
+  // Begin: Pump
+  // ----------------------------------
+
+  // A key every pump (e.g., key repeat) does not keep queued Cmds from running
+  void cmd_runs_under_steady_input() {
+    bool delivered{};
+    App app{[] {
+      auto [model, is_quit, cmd] = init_counted();
+      return std::tuple{model,is_quit,Cmd{[] {return std::optional<Msg>{7};}}};
+    },view_counted,[&delivered](Counted model, Msg msg) {
+      delivered = delivered or msg == 7;
+      return update_counted(model, msg);
+    }};
+    int step{};
+    app.run(0,nullptr,[&](std::vector<int>& keys) {
+      keys.push_back((++step < 100) ? '1' : 'q');
+      return true;
+    });
+    check(delivered,"the Cmd's Msg before the input stopped");
+  }
+
+  // A window that was exposed once (its content lost)
+  class Exposed : public runtime::Headless {
+  public:
+    using Headless::Headless;
+    bool needs_redraw() {return std::exchange(m_exposed,false);}
+    void expose() {m_exposed = true;}
+  private:
+    bool m_exposed{false};
+  };
+
+  void redraws_when_exposed() {
+    Runtime<Counted,Msg,Cmd,Exposed> app{init_counted,view_counted,update_counted};
+    int step{};
+    Exposed* window{};
+    Exposed exposed{[&](std::vector<int>&) {
+      if (++step == 3) window->expose();
+      return step < 10; // No keys (the model never changes)
+    }};
+    window = &exposed;
+    app.run(0,nullptr,exposed);
+    check(exposed.frames() == 2,std::format("the first frame and one redraw, frames:{}",exposed.frames()));
+  }
+
+#ifdef __linux__
+  // A window whose input is waited for (as glfwWaitEventsTimeout), not read from an fd
+  class Waiting : public runtime::Headless {
+  public:
+    using Headless::Headless;
+    void wait(int timeout_ms) {m_waits.push_back(timeout_ms);}
+    std::vector<int> const& waits() const {return m_waits;}
+  private:
+    std::vector<int> m_waits{};
+  };
+
+  // Without an fd, subscription or Task due, an idle session blocks in the backend instead of polling it
+  void idle_session_waits_for_backend() {
+    Runtime<Counted,Msg,Cmd,Waiting> app{init_counted,view_counted,update_counted};
+    int step{};
+    Waiting waiting{[&step](std::vector<int>&) {return ++step < 5;}};
+    app.run(0,nullptr,waiting);
+    check(not waiting.waits().empty() and std::ranges::all_of(waiting.waits(), [](int ms) {return ms == -1;}),
+          std::format("waited without a timeout, waits:{}",waiting.waits().size()));
+  }
+#endif
+
+  // ----------------------------------
+  // End: Pump
+  // ----------------------------------
+
+  // ----------------------------------
+  // Begin: Allocations
+  // ----------------------------------
+
+  // Types warmup keys, then frames keys under budget (counted from there), then quits.
+  // Returns the size of the text the last frame referenced.
+  std::size_t run_budgeted(App& app, runtime::alloc::Budget const& budget, int warmup = 10, int frames = 100) {
+    int step{};
+    runtime::Headless headless{[&](std::vector<int>& keys) {
+      if (step == warmup) {
+        runtime::alloc::take(); // The warmup is not counted
+        app.set_allocation_budget(budget);
+      }
+      keys.push_back((step++ < warmup + frames) ? '1' : 'q');
+      return true;
+    }};
+    app.run(0,nullptr,headless);
+    check(step > warmup + frames,"all frames run");
+    return headless.text_bytes();
+  }
+
+  std::string const LARGE_TEXT(1 << 20, 'x');
+
+  void text_ref_renders_without_allocating() {
+    App app{init_counted,[](Counted const& model) {
+      auto ui = view_counted(model);
+      ui.set_text_ref(ui.doc.append_child("div"), LARGE_TEXT); // Not copied into the document
+      return ui;
+    },update_counted};
+    app.set_frame_memory();
+    runtime::alloc::Budget budget{};
+    budget.fail = true;
+    budget.limit(runtime::alloc::Phase::View,0).limit(runtime::alloc::Phase::Render,0);
+    check(run_budgeted(app, budget) == LARGE_TEXT.size(),"the referenced text rendered");
+  }
+
+  // The frame arenas keep steady state views off the global heap, also while every frame is logged
+  void frame_memory_steady_state() {
+    App app{init_counted,view_counted,update_counted};
+    app.set_frame_memory();
+    runtime::alloc::Budget budget{};
+    budget.fail = true;
+    budget.limit(runtime::alloc::Phase::View,0).limit(runtime::alloc::Phase::Render,0).limit(runtime::alloc::Phase::Other,0);
+    auto const logger = spdlog::default_logger();
+    auto const level = spdlog::get_level();
+    auto restore_logger = [&] {
+      spdlog::set_default_logger(logger);
+      spdlog::set_level(level);
+    };
+    spdlog::set_default_logger(std::make_shared<spdlog::logger>("null",std::make_shared<spdlog::sinks::null_sink_mt>()));
+    spdlog::set_level(spdlog::level::info); // The frame reports are made
+    try {run_budgeted(app, budget);}
+    catch (...) {
+      restore_logger();
+      throw;
+    }
+    restore_logger();
+  }
+
+  void budget_exceeded_fails() {
+    App app{init_counted,[](Counted const& model) {
+      auto ui = view_counted(model);
+      ui.doc.append_child("div").text().set(LARGE_TEXT.c_str()); // Copied (allocates)
+      return ui;
+    },update_counted};
+    runtime::alloc::Budget budget{};
+    budget.fail = true;
+    budget.limit(runtime::alloc::Phase::View,0);
+    std::string failure{};
+    try {run_budgeted(app, budget);}
+    catch (std::runtime_error const& e) {failure = e.what();}
+    check(failure.contains("over allocation budget") and failure.contains("view:"),std::format("failed on the view, failure:'{}'",failure));
+  }
+
+  // ----------------------------------
+  // End: Allocations
+  // ----------------------------------
+
+  // ----------------------------------
+  // Begin: First app (see first.hpp)
+  // ----------------------------------
+
+  using FirstApp = Runtime<first::Model,first::Msg,first::Cmd,runtime::Headless>;
+
+  // The option keys path and stack depth of the first app, as last drawn
+  struct FirstPath {
+    std::vector<std::string> keys{};
+    std::size_t depth{};
+  };
+
+  // Runs the first app with keys read in one go (a paste), then lets its queued work run
+  FirstPath first_paste(std::string_view keys) {
+    FirstPath result{};
+    FirstApp app{first::init,[&result](first::Model const& model) {
+      result = FirstPath{model.keys,model.stack.size()};
+      return first::view(model);
+    },first::update,first::update_batch};
+    int step{};
+    app.run(0,nullptr,[&](std::vector<int>& typed) {
+      if (step == 0) typed.insert(typed.end(),keys.begin(),keys.end());
+      return ++step < 100;
+    });
+    return result;
+  }
+
+  // Pasted keys follow the path as typed one by one, however many transitions are pending
+  void first_paste_follows_path() {
+    auto deep = first_paste("000015"); // Menus, May to April, the RBD:s, 10 .. 19, RBD #15
+    check(deep.keys == std::vector<std::string>{"0","0","0","0","1","5"} and deep.depth == 7,std::format("to RBD #15, depth:{}",deep.depth));
+    auto back = first_paste("0001-1x"); // Back while the balanced RBD:s are pending, and then to them again
+    check(back.keys == std::vector<std::string>{"0","0","0","1"} and back.depth == 5,std::format("back and again, depth:{}",back.depth));
+  }
+
+  // Both strategies split any range into at most fanout contiguous, non-empty sub-ranges covering it
+  void range_partition_strategies() {
+    using Partition = first::RangePartition;
+    using Strategy = Partition::Strategy;
+    for (auto strategy : {Strategy::PowerOfFanout,Strategy::Balanced}) {
+      for (std::size_t fanout : {2,10,35}) {
+        for (std::size_t size : {0,1,2,9,10,11,34,35,36,99,100,101,1234,1000000}) {
+          Partition const partition{Partition::Range{7,7+size},fanout,strategy};
+          auto const subranges = partition.subranges();
+          auto const what = std::format("fanout:{} size:{} strategy:{}",fanout,size,static_cast<int>(strategy));
+          check(subranges.size() <= fanout and (size == 0) == subranges.empty(),"count "+what);
+          std::size_t next{7};
+          for (auto const& [begin, end] : subranges) {
+            check(begin == next and end > begin,"contiguous and non-empty "+what);
+            next = end;
+          }
+          check(next == 7+size,"covers the range "+what);
+          if (subranges.empty()) continue;
+          auto const [smallest, largest] = std::ranges::minmax(subranges | std::views::transform([](auto const& range) {return range.second-range.first;}));
+          if (strategy == Strategy::Balanced) check(largest - smallest <= 1,"balanced sizes "+what);
+          else check(std::ranges::all_of(subranges | std::views::take(subranges.size()-1),[largest](auto const& range) {return range.second-range.first == largest;}),"power of fanout steps "+what);
+        }
+      }
+    }
+    Partition const power{Partition::Range{0,1234}};
+    check(power.subranges() == std::vector<Partition::Range>{{0,1000},{1000,1234}},"1234 by powers of 10");
+    Partition const balanced{Partition::Range{0,1234},10,Strategy::Balanced};
+    check(balanced.subrange(0) == Partition::Range{0,124} and balanced.subrange(3) == Partition::Range{372,496}
+          and balanced.subrange(4) == Partition::Range{496,619} and balanced.subrange(9) == Partition::Range{1111,1234},"1234 in 10 balanced");
+    auto range_of = [](std::optional<Partition> const& partition) {return partition ? partition->m_range : Partition::Range{};};
+    check(range_of(power.descend("")) == Partition::Range{0,1234},"descend no keys");
+    check(range_of(power.descend("12")) == Partition::Range{1200,1234},"descend to the last sub-range");
+    check(range_of(power.descend("1233")) == Partition::Range{1233,1234},"descend to the last row");
+    check(not power.descend("13") and not power.descend("2") and not power.descend("1q"),"descend past the last sub-range");
+    check(range_of(balanced.descend("9")) == Partition::Range{1111,1234},"descend balanced");
+    check(range_of(balanced.descend("99")) == Partition::Range{1222,1234} and not balanced.descend("9999a"),"descend balanced to the end");
+  }
+
+  // "/<keys>" jumps to the sub-range or row at the end of the keys path, as one StateImpl
+  void rbds_jump() {
+    auto names = std::make_shared<first::RBDsState::RBDs>();
+    for (std::size_t i=0;i<1234;++i) names->push_back(std::format("RBD #{}",i));
+    first::RBDsState rbds{names};
+    auto const range = rbds.jump("/12");
+    auto const range_state = range ? std::dynamic_pointer_cast<first::RBDsState>(range->state) : nullptr;
+    check(range_state and range->keys == "12" and range_state->m_partition.m_range == first::RangePartition::Range{1200,1234},"to a sub-range");
+    auto const row = rbds.jump("/1233");
+    auto const row_state = row ? std::dynamic_pointer_cast<first::RBDState>(row->state) : nullptr;
+    check(row_state and row->keys == "1233" and row_state->m_rbd == "RBD #1233","to the last row");
+    check(not rbds.jump("12") and not rbds.jump("/") and not rbds.jump("/13") and not rbds.jump("/12345"),"no jump off the path");
+  }
+
+  // The top section of the first app as last drawn: its window attributes and its text
+  struct FirstWindow {
+    std::size_t first{};
+    std::size_t lines{};
+    std::string text{};
+    bool operator==(FirstWindow const&) const = default;
+  };
+
+  // PgDn/PgUp move the top section a page (page_lines) at a time, the last page stays full,
+  // and the view declares the window shown (data-first, data-lines)
+  void first_pages_through_rows() {
+    FirstWindow shown{};
+    FirstApp app{first::init,[&shown](first::Model const& model) {
+      auto ui = first::view(model);
+      auto const top = ui.doc.child("html").child("body").child("div");
+      shown = FirstWindow{top.attribute("data-first").as_ullong(),top.attribute("data-lines").as_ullong(),std::string{ui.texts[top.attribute("data-text").as_uint()]}};
+      return ui;
+    },first::update,first::update_batch};
+    auto const PAGE_DOWN = runtime::Headless::KEY_PAGE_DOWN;
+    auto const PAGE_UP = runtime::Headless::KEY_PAGE_UP;
+    std::vector<int> const pages{PAGE_DOWN,PAGE_DOWN,PAGE_DOWN,PAGE_UP,PAGE_UP};
+    std::vector<FirstWindow> seen{};
+    int step{};
+    runtime::Headless headless{[&](std::vector<int>& typed) {
+      if (step == 0) for (auto ch : std::string_view{"0000"}) typed.push_back(ch); // The 24 RBD:s of May to April
+      else if (step >= 30 and step % 10 == 0) { // Loaded
+        seen.push_back(shown);
+        if (seen.size() <= pages.size()) typed.push_back(pages[seen.size()-1]);
+      }
+      return ++step <= 30 + 10*static_cast<int>(pages.size());
+    },10};
+    app.run(0,nullptr,headless);
+    auto rows = [](std::size_t first) {
+      std::string result{};
+      for (auto i=first;i<first+10;++i) result += std::format("{}{}. RBD #{}",(i > first) ? "\n" : "",i,i);
+      return result;
+    };
+    std::vector<FirstWindow> const expected{{0,24,rows(0)},{10,24,rows(10)},{14,24,rows(14)},{14,24,rows(14)},{4,24,rows(4)},{0,24,rows(0)}};
+    std::string firsts{};
+    for (auto const& window : seen) firsts += std::format(" {}/{}",window.first,window.lines);
+    check(seen == expected,std::format("pages shown from rows{}",firsts));
+  }
+
+  // A static Menu is pushed at once, so going in and out of one (here the Workspace) allocates nothing
+  // in update or Cmds, once the model's containers have grown
+  void first_menu_without_allocation() {
+    std::size_t depth{};
+    std::size_t changes{}; // Depth changes drawn once budgeted
+    bool budgeted{};
+    FirstApp app{first::init,[&](first::Model const& model) {
+      if (budgeted and model.stack.size() != depth) ++changes;
+      depth = model.stack.size();
+      return first::view(model);
+    },first::update,first::update_batch};
+    int step{};
+    runtime::Headless headless{[&](std::vector<int>& keys) {
+      if (step == 10) {
+        runtime::alloc::take(); // The warmup is not counted
+        runtime::alloc::Budget budget{};
+        budget.fail = true;
+        budget.limit(runtime::alloc::Phase::Update,0).limit(runtime::alloc::Phase::Cmd,0);
+        app.set_allocation_budget(budget);
+        budgeted = true;
+      }
+      keys.push_back((step++ % 2 == 0) ? '0' : '-'); // Workspace x (a Menu) and back
+      return step < 110;
+    }};
+    app.run(0,nullptr,headless);
+    check(step == 110 and changes >= 90,std::format("entered and left, depth changes:{}",changes));
+  }
+
+  // Rows built in parallel chunks are the rows built one by one, at the thread and chunk boundaries too
+  void build_rows_parallel_matches_serial() {
+    auto const MIN = first::MIN_ROWS_PER_THREAD;
+    std::vector<std::string> names{};
+    for (std::size_t i=0;i<4*MIN+3;++i) names.push_back(std::format("RBD #{}",i));
+    auto serial = [&names](std::size_t begin, std::size_t end) {
+      std::vector<std::string> result{};
+      for (auto i=begin;i<end;++i) result.push_back(std::format("{}. {}",i,names[i]));
+      return result;
+    };
+    std::pair<std::size_t,std::size_t> const ranges[]{
+       {0,0},{0,1},{0,MIN-1},{0,MIN},{0,MIN+1},{1,2*MIN},{0,2*MIN},{0,2*MIN+1},{5,2*MIN+5}
+      ,{0,3*MIN-1},{MIN-1,4*MIN+2},{0,4*MIN+3},{3,4*MIN+3}};
+    for (std::size_t threads : {1,2,3,4,7}) {
+      for (auto const& [begin, end] : ranges) {
+        check(first::build_rows(names,begin,end,threads) == serial(begin,end),std::format("rows [{},{}[ on {} threads",begin,end,threads));
+      }
+    }
+  }
+
+  // ----------------------------------
+  // End: First app
+  // ----------------------------------
+
+  struct Test {
+    std::string_view name;
+    void (*fn)();
+  };
+
+  Test const TESTS[]{
+     {"update_batch_drains_queue",update_batch_drains_queue}
+    ,{"file_watch_delivers_msg",file_watch_delivers_msg}
+    ,{"file_watch_follows_rotation",file_watch_follows_rotation}
+    ,{"every_rejects_zero_interval",every_rejects_zero_interval}
+    ,{"cmd_runs_under_steady_input",cmd_runs_under_steady_input}
+    ,{"redraws_when_exposed",redraws_when_exposed}
+#ifdef __linux__
+    ,{"idle_session_waits_for_backend",idle_session_waits_for_backend}
+#endif
+    ,{"text_ref_renders_without_allocating",text_ref_renders_without_allocating}
+    ,{"frame_memory_steady_state",frame_memory_steady_state}
+    ,{"budget_exceeded_fails",budget_exceeded_fails}
+    ,{"const_selector_memoizes",const_selector_memoizes}
+    ,{"snapshot_save_failure_retried",snapshot_save_failure_retried}
+#ifdef __linux__
+    ,{"snapshot_write_error_reported",snapshot_write_error_reported}
+#endif
+    ,{"task_awaits_task",task_awaits_task}
+    ,{"task_awaits_throwing_task",task_awaits_throwing_task}
+    ,{"task_cmd_cancelled",task_cmd_cancelled}
+    ,{"task_cmd_runs_once",task_cmd_runs_once}
+    ,{"task_exception_keeps_others",task_exception_keeps_others}
+#ifdef __linux__
+    ,{"fd_waited_twice_reported",fd_waited_twice_reported}
+    ,{"tasks_await_same_fd",tasks_await_same_fd}
+    ,{"serve_drops_failing_session",serve_drops_failing_session}
+    ,{"serve_large_frames_and_signals",serve_large_frames_and_signals}
+    ,{"remote_round_trip",remote_round_trip}
+    ,{"decoder_rejects_malformed",decoder_rejects_malformed}
+    ,{"remote_rejects_malformed_key",remote_rejects_malformed_key}
+#endif
+    ,{"first_paste_follows_path",first_paste_follows_path}
+    ,{"range_partition_strategies",range_partition_strategies}
+    ,{"rbds_jump",rbds_jump}
+    ,{"first_pages_through_rows",first_pages_through_rows}
+    ,{"build_rows_parallel_matches_serial",build_rows_parallel_matches_serial}
+    ,{"first_menu_without_allocation",first_menu_without_allocation}
+  };
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  spdlog::set_level(spdlog::level::warn); // The runtime logs every loop at info
+  int failed{};
+  for (auto const& test : TESTS) {
+    if (argc > 1 and test.name != argv[1]) continue;
+    try {
+      test.fn();
+      std::cout << std::format("PASS {}\n",test.name);
+    }
+    catch (std::exception const& e) {
+      ++failed;
+      std::cout << std::format("FAIL {}: {}\n",test.name,e.what());
+    }
+  }
+  return (failed == 0) ? 0 : 1;
+}